@@ -0,0 +1,644 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+
+#include <linux/input.h>
+#include <linux/io_uring.h>
+
+#include "aggregator.h"
+#include "stats.h"
+
+#define AGG_REORDER_WINDOW_US 1000
+#define AGG_RING_ENTRIES 256
+#define AGG_NUM_BUFS 512                 /* must be a power of 2 */
+#define AGG_BUF_SIZE (64 * sizeof(struct input_event))
+#define AGG_BGID 0
+#define AGG_TIMER_TAG 0xffffffffULL
+#define AGG_LATENCY_BUCKETS 24           /* log2 buckets, microseconds */
+
+/* not yet part of all kernel headers, available since linux 6.7 */
+#define AGG_OP_READ_MULTISHOT 49
+
+/* Globals */
+extern int verbose_flag;
+
+typedef struct {
+    char *name;
+    int fd;
+    int hidraw;
+    int open;
+    int singleread;                      /* multishot read was rejected for this device */
+    unsigned long long samples;
+} aggdevice;
+
+typedef struct {
+    aggdevice devices[MAX_AGGREGATE_DEVICES];
+    int numDevices;
+    int numOpen;
+
+    /* reorder buffer, binary min heap on (ts, seq) */
+    aggsample *heap;
+    int heapSize;
+    int heapCapacity;
+    unsigned long long seq;
+
+    unsigned long long emitted;
+    unsigned long long latency[AGG_LATENCY_BUCKETS];
+    long long latencyMax;
+    long long latencySum;
+} aggstate;
+
+typedef struct {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+    unsigned pending;                    /* sqes not yet submitted */
+
+    struct io_uring_buf_ring *br;
+    size_t br_size;
+    unsigned char *bufs;
+    int multishot;
+} aggring;
+
+static volatile sig_atomic_t stop_aggregation = 0;
+
+static void handle_stop(int sig)
+{
+    stop_aggregation = 1;
+}
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/*
+ * Reorder buffer
+ */
+static int sample_before(aggsample *a, aggsample *b)
+{
+    return a->ts < b->ts || (a->ts == b->ts && a->seq < b->seq);
+}
+
+static void heap_push(aggstate *s, aggsample *sample)
+{
+    if (s->heapSize == s->heapCapacity) {
+        s->heapCapacity = s->heapCapacity ? s->heapCapacity * 2 : 1024;
+        s->heap = realloc(s->heap, s->heapCapacity * sizeof(aggsample));
+        if (!s->heap) {
+            perror("Grow reorder buffer");
+            exit(1);
+        }
+    }
+    int i = s->heapSize++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!sample_before(sample, &s->heap[parent]))
+            break;
+        s->heap[i] = s->heap[parent];
+        i = parent;
+    }
+    s->heap[i] = *sample;
+}
+
+static void heap_pop(aggstate *s, aggsample *out)
+{
+    *out = s->heap[0];
+    aggsample last = s->heap[--s->heapSize];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= s->heapSize)
+            break;
+        if (child + 1 < s->heapSize && sample_before(&s->heap[child + 1], &s->heap[child]))
+            child++;
+        if (!sample_before(&s->heap[child], &last))
+            break;
+        s->heap[i] = s->heap[child];
+        i = child;
+    }
+    if (s->heapSize)
+        s->heap[i] = last;
+}
+
+static void emit_sample(aggstate *s, aggsample *sample, long long now)
+{
+    long long latency = now - sample->ts;
+    if (latency < 0)
+        latency = 0;
+    long long us = latency / 1000;
+    int bucket = 0;
+    while (us > 1 && bucket < AGG_LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    s->latency[bucket]++;
+    s->latencySum += latency;
+    if (latency > s->latencyMax)
+        s->latencyMax = latency;
+    s->emitted++;
+
+    if (verbose_flag) {
+        printf("%lld.%06lld %s type %d code %d value %d\n", sample->ts / 1000000000LL, (sample->ts / 1000) % 1000000,
+               s->devices[sample->device].name, sample->type, sample->code, sample->value);
+    }
+}
+
+/*
+ * Emit all samples older than the reorder window, or all if flush is set
+ */
+static void drain_samples(aggstate *s, int flush)
+{
+    long long now = now_ns();
+    long long limit = now - AGG_REORDER_WINDOW_US * 1000LL;
+    aggsample sample;
+    while (s->heapSize && (flush || s->heap[0].ts <= limit)) {
+        heap_pop(s, &sample);
+        emit_sample(s, &sample, now);
+    }
+}
+
+/*
+ * Turn the result of one read into samples
+ */
+static void parse_buffer(aggstate *s, int device, unsigned char *buf, int len)
+{
+    static int samples = -1;
+    aggdevice *d = &s->devices[device];
+    aggsample sample;
+    sample.device = device;
+
+    if (samples < 0)
+        samples = stats_counter("ltwheelconf_input_samples_total", "mode=\"aggregate\"", "Input samples read");
+
+    if (d->hidraw) {
+        sample.ts = now_ns();
+        sample.seq = s->seq++;
+        sample.type = AGG_HIDRAW_REPORT;
+        sample.code = len ? buf[0] : 0;
+        sample.value = len;
+        heap_push(s, &sample);
+        d->samples++;
+        stats_add(samples, 1);
+        return;
+    }
+
+    int numEvents = len / sizeof(struct input_event);
+    unsigned long long before = d->samples;
+    int i;
+    for (i = 0; i < numEvents; i++) {
+        struct input_event *ie = (struct input_event *)(buf + i * sizeof(struct input_event));
+        if (ie->type == EV_SYN)
+            continue;
+        sample.ts = (long long)ie->time.tv_sec * 1000000000LL + ie->time.tv_usec * 1000LL;
+        sample.seq = s->seq++;
+        sample.type = ie->type;
+        sample.code = ie->code;
+        sample.value = ie->value;
+        heap_push(s, &sample);
+        d->samples++;
+    }
+    stats_add(samples, d->samples - before);
+}
+
+static void close_device(aggstate *s, int device, int err)
+{
+    aggdevice *d = &s->devices[device];
+    if (!d->open)
+        return;
+    if (err)
+        printf("Device %s: %s, no longer reading it.\n", d->name, strerror(err));
+    else
+        printf("Device %s: end of file, no longer reading it.\n", d->name);
+    close(d->fd);
+    d->open = 0;
+    s->numOpen--;
+}
+
+
+/*
+ * io_uring, set up by hand to not depend on liburing
+ */
+static int ring_setup(aggring *r)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = syscall(__NR_io_uring_setup, AGG_RING_ENTRIES, &p);
+    if (r->fd < 0)
+        return -1;
+
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size)
+            r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+    r->sq_ptr = mmap(0, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+        goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(0, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED)
+            goto fail;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(0, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto fail;
+
+    r->sq_tail = (unsigned *)((char *)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)((char *)r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned *)((char *)r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned *)((char *)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+
+    /* register ring of provided buffers, the kernel picks one for every completed read */
+    r->br_size = AGG_NUM_BUFS * sizeof(struct io_uring_buf);
+    r->br = mmap(0, r->br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r->br == MAP_FAILED)
+        goto fail;
+    r->bufs = malloc(AGG_NUM_BUFS * AGG_BUF_SIZE);
+    if (!r->bufs)
+        goto fail;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)r->br;
+    reg.ring_entries = AGG_NUM_BUFS;
+    reg.bgid = AGG_BGID;
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        goto fail;
+
+    int i;
+    for (i = 0; i < AGG_NUM_BUFS; i++) {
+        struct io_uring_buf *buf = &r->br->bufs[i];
+        buf->addr = (unsigned long)(r->bufs + i * AGG_BUF_SIZE);
+        buf->len = AGG_BUF_SIZE;
+        buf->bid = i;
+    }
+    __atomic_store_n(&r->br->tail, AGG_NUM_BUFS, __ATOMIC_RELEASE);
+    r->multishot = 1;
+    return 0;
+
+fail:
+    if (verbose_flag) perror("Setting up io_uring");
+    close(r->fd);
+    r->fd = -1;
+    return -1;
+}
+
+static void ring_free(aggring *r)
+{
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_size);
+    if (r->sq_ptr && r->sq_ptr != MAP_FAILED)
+        munmap(r->sq_ptr, r->sq_size);
+    if (r->br && r->br != MAP_FAILED)
+        munmap(r->br, r->br_size);
+    free(r->bufs);
+    if (r->fd >= 0)
+        close(r->fd);
+}
+
+static struct io_uring_sqe *ring_get_sqe(aggring *r)
+{
+    unsigned tail = *r->sq_tail + r->pending;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[index] = index;
+    r->pending++;
+    return sqe;
+}
+
+static void ring_arm_read(aggring *r, int device, int fd)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(r);
+    sqe->opcode = r->multishot ? AGG_OP_READ_MULTISHOT : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = AGG_BGID;
+    sqe->len = r->multishot ? 0 : AGG_BUF_SIZE;
+    sqe->off = -1;
+    sqe->user_data = device;
+}
+
+static void ring_arm_timer(aggring *r, int timerfd, unsigned long long *expirations)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(r);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = timerfd;
+    sqe->addr = (unsigned long)expirations;
+    sqe->len = sizeof(*expirations);
+    sqe->off = -1;
+    sqe->user_data = AGG_TIMER_TAG;
+}
+
+static void ring_recycle_buffer(aggring *r, int bid)
+{
+    unsigned short tail = r->br->tail;
+    struct io_uring_buf *buf = &r->br->bufs[tail & (AGG_NUM_BUFS - 1)];
+    buf->addr = (unsigned long)(r->bufs + bid * AGG_BUF_SIZE);
+    buf->len = AGG_BUF_SIZE;
+    buf->bid = bid;
+    __atomic_store_n(&r->br->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int ring_submit_and_wait(aggring *r)
+{
+    unsigned submit = r->pending;
+    __atomic_store_n(r->sq_tail, *r->sq_tail + r->pending, __ATOMIC_RELEASE);
+    r->pending = 0;
+    int ret = syscall(__NR_io_uring_enter, r->fd, submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0 && errno != EINTR)
+        return -1;
+    return 0;
+}
+
+static int run_uring(aggstate *s, int timerfd, long long deadline)
+{
+    aggring r;
+    unsigned long long expirations;
+    int i;
+
+    if (ring_setup(&r) != 0) {
+        ring_free(&r);
+        return -1;
+    }
+    if (verbose_flag) printf("Reading %d devices through io_uring.\n", s->numDevices);
+
+    for (i = 0; i < s->numDevices; i++) {
+        if (s->devices[i].open)
+            ring_arm_read(&r, i, s->devices[i].fd);
+    }
+    ring_arm_timer(&r, timerfd, &expirations);
+
+    while (!stop_aggregation && s->numOpen > 0) {
+        if (ring_submit_and_wait(&r) != 0) {
+            perror("io_uring_enter");
+            break;
+        }
+
+        unsigned head = *r.cq_head;
+        unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+
+            if (cqe->user_data == AGG_TIMER_TAG) {
+                drain_samples(s, 0);
+                if (deadline && now_ns() >= deadline)
+                    stop_aggregation = 1;
+                ring_arm_timer(&r, timerfd, &expirations);
+                continue;
+            }
+
+            int device = cqe->user_data;
+            aggdevice *d = &s->devices[device];
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                parse_buffer(s, device, r.bufs + bid * AGG_BUF_SIZE, cqe->res);
+                ring_recycle_buffer(&r, bid);
+            } else if (cqe->res == -EINVAL && d->samples == 0 && !d->singleread) {
+                /* kernel does not know multishot reads, continue with plain reads */
+                if (verbose_flag && r.multishot) printf("No multishot read support, re-arming single reads.\n");
+                r.multishot = 0;
+                d->singleread = 1;
+            } else if (cqe->res == 0) {
+                close_device(s, device, 0);
+                continue;
+            } else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -EAGAIN && cqe->res != -EINTR) {
+                close_device(s, device, -cqe->res);
+                continue;
+            }
+            /* multishot reads stay armed as long as IORING_CQE_F_MORE is set */
+            if (d->open && !(r.multishot && (cqe->flags & IORING_CQE_F_MORE)))
+                ring_arm_read(&r, device, d->fd);
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+    }
+    ring_free(&r);
+    return 0;
+}
+
+static int run_epoll(aggstate *s, int timerfd, long long deadline)
+{
+    struct epoll_event ev;
+    struct epoll_event events[MAX_AGGREGATE_DEVICES + 1];
+    unsigned char buf[AGG_BUF_SIZE];
+    int i;
+
+    int epfd = epoll_create(MAX_AGGREGATE_DEVICES + 1);
+    if (epfd < 0) {
+        perror("epoll_create");
+        return -1;
+    }
+    if (verbose_flag) printf("Reading %d devices through epoll.\n", s->numDevices);
+
+    for (i = 0; i < s->numDevices; i++) {
+        if (!s->devices[i].open)
+            continue;
+        fcntl(s->devices[i].fd, F_SETFL, fcntl(s->devices[i].fd, F_GETFL) | O_NONBLOCK);
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, s->devices[i].fd, &ev);
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = AGG_TIMER_TAG;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev);
+
+    while (!stop_aggregation && s->numOpen > 0) {
+        int n = epoll_wait(epfd, events, MAX_AGGREGATE_DEVICES + 1, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (events[i].data.u64 == AGG_TIMER_TAG) {
+                unsigned long long expirations;
+                if (read(timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                    perror("Read timer");
+                drain_samples(s, 0);
+                if (deadline && now_ns() >= deadline)
+                    stop_aggregation = 1;
+                continue;
+            }
+            int device = events[i].data.u64;
+            aggdevice *d = &s->devices[device];
+            for (;;) {
+                ssize_t len = read(d->fd, buf, sizeof(buf));
+                if (len > 0) {
+                    parse_buffer(s, device, buf, len);
+                    continue;
+                }
+                if (len == 0)
+                    close_device(s, device, 0);
+                else if (errno != EAGAIN && errno != EINTR)
+                    close_device(s, device, errno);
+                break;
+            }
+        }
+    }
+    close(epfd);
+    return 0;
+}
+
+static void print_report(aggstate *s, long long elapsed, struct rusage *before, struct rusage *after)
+{
+    double cpu = (after->ru_utime.tv_sec - before->ru_utime.tv_sec) + (after->ru_stime.tv_sec - before->ru_stime.tv_sec)
+                 + ((after->ru_utime.tv_usec - before->ru_utime.tv_usec)
+                    + (after->ru_stime.tv_usec - before->ru_stime.tv_usec)) / 1e6;
+    double seconds = elapsed / 1e9;
+    int i;
+
+    printf("Aggregated %llu samples from %d devices in %.2f seconds (%.0f samples/s).\n",
+           s->emitted, s->numDevices, seconds, seconds > 0 ? s->emitted / seconds : 0);
+    for (i = 0; i < s->numDevices; i++) {
+        printf("\t%s: %llu samples (%.0f samples/s)\n", s->devices[i].name, s->devices[i].samples,
+               seconds > 0 ? s->devices[i].samples / seconds : 0);
+    }
+    printf("CPU time %.3f s, %.0f samples per CPU second.\n", cpu, cpu > 0 ? s->emitted / cpu : 0);
+    if (!s->emitted)
+        return;
+
+    /* percentiles are reported as upper bound of the log2 bucket */
+    unsigned long long p50 = 0, p99 = 0, count = 0;
+    for (i = 0; i < AGG_LATENCY_BUCKETS; i++) {
+        count += s->latency[i];
+        if (!p50 && count * 2 >= s->emitted)
+            p50 = 1ULL << (i + 1);
+        if (!p99 && count * 100 >= s->emitted * 99)
+            p99 = 1ULL << (i + 1);
+    }
+    printf("Latency (event to merged output, including %d us reorder window): avg %lld us, p50 <= %llu us, p99 <= %llu us, max %lld us\n",
+           AGG_REORDER_WINDOW_US, s->latencySum / (long long)s->emitted / 1000, p50, p99, s->latencyMax / 1000);
+}
+
+int aggregate_devices(char **device_file_names, int numDevices, int duration_sec)
+{
+    aggstate s;
+    int i;
+    int clk = CLOCK_MONOTONIC;
+
+    if (numDevices > MAX_AGGREGATE_DEVICES) {
+        printf("Can not aggregate more than %d devices.\n", MAX_AGGREGATE_DEVICES);
+        return -1;
+    }
+
+    memset(&s, 0, sizeof(s));
+    for (i = 0; i < numDevices; i++) {
+        aggdevice *d = &s.devices[i];
+        d->name = device_file_names[i];
+        d->hidraw = (strstr(d->name, "hidraw") != NULL);
+        d->fd = open(d->name, O_RDONLY);
+        if (d->fd == -1) {
+            perror(d->name);
+            continue;
+        }
+        /* have evdev timestamps on the same clock we use to measure latency */
+        if (!d->hidraw && ioctl(d->fd, EVIOCSCLOCKID, &clk) != 0 && verbose_flag)
+            printf("Device %s: unable to switch to monotonic timestamps.\n", d->name);
+        d->open = 1;
+        s.numOpen++;
+    }
+    s.numDevices = numDevices;
+    if (!s.numOpen) {
+        printf("No device could be opened.\n");
+        return -1;
+    }
+
+    /* periodic timer to flush the reorder buffer and check for the end of the run */
+    int timerfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (timerfd < 0) {
+        perror("timerfd_create");
+        return -1;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_interval.tv_nsec = AGG_REORDER_WINDOW_US * 1000L;
+    its.it_value.tv_nsec = AGG_REORDER_WINDOW_US * 1000L;
+    timerfd_settime(timerfd, 0, &its, NULL);
+
+    stop_aggregation = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    long long start = now_ns();
+    long long deadline = duration_sec ? start + duration_sec * 1000000000LL : 0;
+
+    if (run_uring(&s, timerfd, deadline) != 0) {
+        printf("io_uring not available, falling back to epoll.\n");
+        run_epoll(&s, timerfd, deadline);
+    }
+    drain_samples(&s, 1);
+
+    long long elapsed = now_ns() - start;
+    getrusage(RUSAGE_SELF, &after);
+    print_report(&s, elapsed, &before, &after);
+
+    for (i = 0; i < numDevices; i++) {
+        if (s.devices[i].open)
+            close(s.devices[i].fd);
+    }
+    close(timerfd);
+    free(s.heap);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef aggregator_h
+#define aggregator_h
+
+#define MAX_AGGREGATE_DEVICES 64
+
+/* type of samples read from hidraw nodes: code is the report id, value the report length */
+#define AGG_HIDRAW_REPORT 0xffff
+
+typedef struct {
+    long long ts;                        /* CLOCK_MONOTONIC, nanoseconds */
+    unsigned long long seq;              /* keeps order of samples with equal timestamps */
+    int device;                          /* index into device list */
+    unsigned short type;
+    unsigned short code;
+    int value;
+} aggsample;
+
+/*
+ * Read evdev and/or hidraw nodes of several wheels (pedals, shifters...) in a single
+ * thread and merge their samples into one stream ordered by timestamp.
+ *
+ * All nodes are read through one io_uring using multishot reads into a registered
+ * buffer ring. Kernels without multishot read support get re-armed single reads,
+ * kernels without io_uring fall back to epoll.
+ *
+ * Samples are held back for AGG_REORDER_WINDOW_US to sort samples arriving late from
+ * one device in between those of others. If verbose output is enabled every merged
+ * sample is printed. At the end throughput per CPU second and latency
+ * (event timestamp to merged output) are reported.
+ *
+ * duration_sec = 0 runs until interrupted.
+ */
+int aggregate_devices(char **device_file_names, int numDevices, int duration_sec);
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include <linux/input.h>
+
+#include "wheels.h"
+#include "wheelfunctions.h"
+#include "inventory.h"
+#include "calibration.h"
+
+/* Globals */
+extern int verbose_flag;
+
+#define test_bit(bit, array) ((array)[(bit) / 8] & (1 << ((bit) % 8)))
+
+
+static void calibration_file_name(const char *key, char *path, size_t len)
+{
+    snprintf(path, len, STATE_DIR "/%s.cal", key);
+}
+
+int read_calibration(int fd, calibration *cal)
+{
+    unsigned char absbits[ABS_CNT / 8 + 1];
+    int code;
+
+    memset(cal, 0, sizeof(*cal));
+    memset(absbits, 0, sizeof(absbits));
+    if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absbits)), absbits) < 0) {
+        perror("Get axes");
+        return -1;
+    }
+    for (code = 0; code < ABS_CNT; code++) {
+        if (!test_bit(code, absbits))
+            continue;
+        if (ioctl(fd, EVIOCGABS(code), &cal->absinfo[cal->numAxes]) < 0) {
+            perror("Get axis info");
+            return -1;
+        }
+        cal->codes[cal->numAxes++] = code;
+    }
+    return 0;
+}
+
+int write_calibration(int fd, calibration *cal)
+{
+    int i;
+    for (i = 0; i < cal->numAxes; i++) {
+        struct input_absinfo current;
+        // keep current value and resolution, only limits are calibrated
+        if (ioctl(fd, EVIOCGABS(cal->codes[i]), &current) < 0) {
+            if (verbose_flag) printf("Axis %d not present, skipping.\n", cal->codes[i]);
+            continue;
+        }
+        current.minimum = cal->absinfo[i].minimum;
+        current.maximum = cal->absinfo[i].maximum;
+        current.fuzz = cal->absinfo[i].fuzz;
+        current.flat = cal->absinfo[i].flat;
+        if (ioctl(fd, EVIOCSABS(cal->codes[i]), &current) < 0) {
+            perror("Set axis info");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int load_calibration(const char *key, calibration *cal)
+{
+    char path[512];
+    char line[256];
+    calibration_file_name(key, path, sizeof(path));
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    memset(cal, 0, sizeof(*cal));
+    while (fgets(line, sizeof(line), f) && cal->numAxes < ABS_CNT) {
+        int code;
+        struct input_absinfo *ai = &cal->absinfo[cal->numAxes];
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%d %d %d %d %d", &code, &ai->minimum, &ai->maximum, &ai->fuzz, &ai->flat) == 5
+            && code >= 0 && code < ABS_CNT) {
+            cal->codes[cal->numAxes++] = code;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int store_calibration(const char *key, calibration *cal)
+{
+    char path[512];
+    int i;
+
+    if (mkdir(STATE_DIR, 0755) != 0 && errno != EEXIST) {
+        perror("Create " STATE_DIR);
+        return -1;
+    }
+    calibration_file_name(key, path, sizeof(path));
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "# axis min max fuzz flat\n");
+    for (i = 0; i < cal->numAxes; i++) {
+        struct input_absinfo *ai = &cal->absinfo[i];
+        fprintf(f, "%d %d %d %d %d\n", cal->codes[i], ai->minimum, ai->maximum, ai->fuzz, ai->flat);
+    }
+    fclose(f);
+    if (verbose_flag) printf("Calibration stored in %s\n", path);
+    return 0;
+}
+
+/*
+ * Read events for given time and track min/max of each axis
+ */
+static void track_axes(int fd, calibration *cal, int *lo, int *hi, int seconds)
+{
+    struct input_event ev[64];
+    struct pollfd pfd;
+    time_t end = time(NULL) + seconds;
+    int i;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (time(NULL) < end) {
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        ssize_t len = read(fd, ev, sizeof(ev));
+        if (len <= 0)
+            break;
+        int numEvents = len / sizeof(struct input_event);
+        int e;
+        for (e = 0; e < numEvents; e++) {
+            if (ev[e].type != EV_ABS)
+                continue;
+            for (i = 0; i < cal->numAxes; i++) {
+                if (cal->codes[i] != ev[e].code)
+                    continue;
+                if (ev[e].value < lo[i])
+                    lo[i] = ev[e].value;
+                if (ev[e].value > hi[i])
+                    hi[i] = ev[e].value;
+            }
+        }
+    }
+}
+
+int calibrate(char *device_file_name, int sweep_sec)
+{
+    calibration cal;
+    char key[256];
+    int lo[ABS_CNT], hi[ABS_CNT];
+    int noise[ABS_CNT];
+    int i;
+
+    int fd = open(device_file_name, O_RDONLY);
+    if (fd == -1) {
+        perror("Open device file");
+        return -1;
+    }
+    if (get_evdev_key(fd, key, sizeof(key)) != 0 || read_calibration(fd, &cal) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (!cal.numAxes) {
+        printf("Device %s has no axes to calibrate.\n", device_file_name);
+        close(fd);
+        return -1;
+    }
+
+    // start tracking at the current position of every axis
+    for (i = 0; i < cal.numAxes; i++) {
+        lo[i] = hi[i] = cal.absinfo[i].value;
+    }
+    printf("Leave wheel and pedals untouched for %d seconds...\n", CALIBRATION_REST_SEC);
+    fflush(stdout);
+    track_axes(fd, &cal, lo, hi, CALIBRATION_REST_SEC);
+    for (i = 0; i < cal.numAxes; i++) {
+        noise[i] = hi[i] - lo[i];
+    }
+
+    printf("Now turn the wheel from lock to lock and press every pedal fully, you have %d seconds...\n", sweep_sec);
+    fflush(stdout);
+    track_axes(fd, &cal, lo, hi, sweep_sec);
+    close(fd);
+
+    for (i = 0; i < cal.numAxes; i++) {
+        struct input_absinfo *ai = &cal.absinfo[i];
+        if (hi[i] - lo[i] <= noise[i]) {
+            // axis was not moved, keep what the driver reports
+            if (verbose_flag) printf("\tAxis %d: not moved, keeping %d..%d\n", cal.codes[i], ai->minimum, ai->maximum);
+            continue;
+        }
+        ai->minimum = lo[i];
+        ai->maximum = hi[i];
+        if (noise[i] / 2 > ai->fuzz)
+            ai->fuzz = noise[i] / 2;
+        if (noise[i] > ai->flat)
+            ai->flat = noise[i];
+        printf("\tAxis %d: min %d, max %d, fuzz %d, flat %d\n", cal.codes[i], ai->minimum, ai->maximum, ai->fuzz, ai->flat);
+    }
+    if (store_calibration(key, &cal) != 0)
+        return -1;
+    printf("Calibration for wheel \"%s\" stored.\n", key);
+    return 0;
+}
+
+int apply_calibration(char *device_file_name, int wait_for_udev)
+{
+    calibration cal;
+    char key[256];
+
+    if (verbose_flag) printf ( "Device %s: Applying stored calibration.\n", device_file_name);
+
+    /* sleep UDEV_WAIT_SEC seconds to allow udev to set up device nodes due to kernel
+     * driver re-attaching while setting native mode or wheel range before
+     */
+    if (wait_for_udev) wait_udev();
+
+    int fd = open(device_file_name, O_RDWR);
+    if (fd == -1) {
+        perror("Open device file");
+        return -1;
+    }
+    if (get_evdev_key(fd, key, sizeof(key)) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (load_calibration(key, &cal) != 0) {
+        printf("No calibration stored for wheel \"%s\". Use --calibrate first.\n", key);
+        close(fd);
+        return -1;
+    }
+    int ret = write_calibration(fd, &cal);
+    close(fd);
+    if (ret == 0)
+        printf("Calibration of %d axes applied.\n", cal.numAxes);
+    return ret;
+}
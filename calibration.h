@@ -0,0 +1,64 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef calibration_h
+#define calibration_h
+
+#include <linux/input.h>
+
+#define STATE_DIR "/var/lib/ltwheelconf"
+#define CALIBRATION_REST_SEC 2
+#define CALIBRATION_SWEEP_SEC 15
+
+typedef struct {
+    int numAxes;
+    unsigned short codes[ABS_CNT];
+    struct input_absinfo absinfo[ABS_CNT];
+} calibration;
+
+/*
+ * Capture calibration of all absolute axes of the event device.
+ *
+ * While the wheel is at rest the noise of every axis is measured, it is used
+ * for fuzz and flat. Afterwards the user sweeps wheel and pedals over their full
+ * range for sweep_sec seconds to find min and max.
+ * The result is stored per wheel (see get_evdev_key()) in STATE_DIR.
+ */
+int calibrate(char *device_file_name, int sweep_sec);
+
+/*
+ * Load stored calibration of the wheel behind device_file_name and write it
+ * to the kernel using EVIOCSABS, so applications get already calibrated axes.
+ */
+int apply_calibration(char *device_file_name, int wait_for_udev);
+
+/*
+ * Read/write calibration from/to an open event device
+ */
+int read_calibration(int fd, calibration *cal);
+int write_calibration(int fd, calibration *cal);
+
+/*
+ * Load/store calibration file for wheel key
+ */
+int load_calibration(const char *key, calibration *cal);
+int store_calibration(const char *key, calibration *cal);
+
+#endif
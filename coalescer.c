@@ -0,0 +1,297 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "wheels.h"
+#include "wheelfunctions.h"
+#include "coalescer.h"
+
+/* Globals */
+extern int verbose_flag;
+
+typedef struct {
+    int pending;
+    int value;
+    int value2;                          /* rampspeed for autocenter */
+    long long last_sent;
+    unsigned long long requested;
+    unsigned long long sent;
+    unsigned long long failed;
+} coalslot;
+
+typedef struct {
+    wheelstruct *wheel;
+    coalslot slots[NUM_COALESCE_SETTINGS];
+    libusb_device_handle *handle;        /* claimed while changes keep coming */
+    long long last_activity;
+} coalwheel;
+
+static coalwheel cwheels[COALESCE_MAX_WHEELS];
+static int numCwheels = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond;
+static pthread_t worker;
+static int running = 0;
+static long long interval_ns = COALESCE_INTERVAL_MS * 1000000LL;
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Returns <0 if the setting could not be sent
+ */
+static int send_setting(coalwheel *cw, int setting, int value, int value2)
+{
+    wheelstruct *w = cw->wheel;
+    cmdstruct c;
+    memset(&c, 0, sizeof(c));
+
+    if (setting == COALESCE_RANGE) {
+        if (!w->get_range_cmd) {
+            printf("Sorry, do not know how to set rotation range for %s.\n", w->name);
+            return -1;
+        }
+        w->get_range_cmd(&c, clamprange(w, value));
+    } else {
+        if (!w->get_autocenter_cmd) {
+            printf("Sorry, do not know how to set autocenter force for %s.\n", w->name);
+            return -1;
+        }
+        w->get_autocenter_cmd(&c, value, value2);
+    }
+
+    if (!cw->handle) {
+        cw->handle = libusb_open_device_with_vid_pid(NULL, VID_LOGITECH, w->native_pid);
+        if (!cw->handle) {
+            printf("%s not found. Make sure it is set to native mode (use --native).\n", w->name);
+            return -1;
+        }
+        // only keep the handle if it is claimed, the next setting tries again
+        if (claim_wheel(cw->handle) < 0) {
+            libusb_close(cw->handle);
+            cw->handle = 0;
+            return -1;
+        }
+    }
+    int stat = send_command_claimed(cw->handle, c);
+    if (stat < 0)
+        return stat;
+    if (verbose_flag) {
+        if (setting == COALESCE_RANGE)
+            printf("Wheel rotation range of %s is now set to %d degrees.\n", w->name, value);
+        else
+            printf("Autocenter for %s is now set to %d with rampspeed %d.\n", w->name, value, value2);
+    }
+    return 0;
+}
+
+static void *coalescer_worker(void *arg)
+{
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        long long now = now_ns();
+        long long wakeup = 0;
+        int pending = 0;
+        int unlocked = 0;                // lock was released, state may have changed meanwhile
+        int i, s;
+
+        for (i = 0; i < numCwheels; i++) {
+            coalwheel *cw = &cwheels[i];
+            for (s = 0; s < NUM_COALESCE_SETTINGS; s++) {
+                coalslot *slot = &cw->slots[s];
+                if (!slot->pending)
+                    continue;
+                long long due = slot->last_sent + interval_ns;
+                if (due > now) {
+                    pending = 1;
+                    if (!wakeup || due < wakeup)
+                        wakeup = due;
+                    continue;
+                }
+                // take newest value and send it without holding the lock
+                int value = slot->value, value2 = slot->value2;
+                slot->pending = 0;
+                slot->last_sent = now;
+                cw->last_activity = now;
+                pthread_mutex_unlock(&lock);
+                int stat = send_setting(cw, s, value, value2);
+                pthread_mutex_lock(&lock);
+                unlocked = 1;
+                if (stat == 0)
+                    slot->sent++;
+                else
+                    slot->failed++;
+                now = now_ns();
+            }
+            // give the wheel back to the kernel driver once changes stopped
+            if (cw->handle) {
+                long long idle = cw->last_activity + COALESCE_IDLE_INTERVALS * interval_ns;
+                if (idle <= now || !running) {
+                    libusb_device_handle *handle = cw->handle;
+                    cw->handle = 0;
+                    pthread_mutex_unlock(&lock);
+                    release_wheel(handle);
+                    libusb_close(handle);
+                    pthread_mutex_lock(&lock);
+                    unlocked = 1;
+                } else if (!wakeup || idle < wakeup) {
+                    wakeup = idle;
+                }
+            }
+        }
+        // a signal sent while the lock was released is lost, look again before waiting
+        if (unlocked)
+            continue;
+        if (!running && !pending) {
+            int busy = 0;
+            for (i = 0; i < numCwheels; i++) {
+                busy |= (cwheels[i].handle != 0);
+            }
+            if (!busy)
+                break;
+            continue;
+        }
+        if (wakeup) {
+            struct timespec ts;
+            ts.tv_sec = wakeup / 1000000000LL;
+            ts.tv_nsec = wakeup % 1000000000LL;
+            pthread_cond_timedwait(&cond, &lock, &ts);
+        } else {
+            pthread_cond_wait(&cond, &lock);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+int coalescer_start(int interval_ms)
+{
+    pthread_condattr_t attr;
+
+    if (running)
+        return 0;
+    interval_ns = interval_ms * 1000000LL;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond, &attr);
+    pthread_condattr_destroy(&attr);
+    running = 1;
+    if (pthread_create(&worker, NULL, coalescer_worker, NULL) != 0) {
+        perror("Start coalescer");
+        running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static void queue_setting(wheelstruct *w, int setting, int value, int value2)
+{
+    int i;
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < numCwheels; i++) {
+        if (cwheels[i].wheel == w)
+            break;
+    }
+    if (i == numCwheels) {
+        if (numCwheels == COALESCE_MAX_WHEELS) {
+            pthread_mutex_unlock(&lock);
+            printf("Too many wheels queued, ignoring change for %s.\n", w->name);
+            return;
+        }
+        memset(&cwheels[i], 0, sizeof(coalwheel));
+        cwheels[i].wheel = w;
+        numCwheels++;
+    }
+    coalslot *slot = &cwheels[i].slots[setting];
+    slot->pending = 1;
+    slot->value = value;
+    slot->value2 = value2;
+    slot->requested++;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+void coalesce_range(wheelstruct *w, int range)
+{
+    queue_setting(w, COALESCE_RANGE, range, 0);
+}
+
+void coalesce_autocenter(wheelstruct *w, int centerforce, int rampspeed)
+{
+    queue_setting(w, COALESCE_AUTOCENTER, centerforce, rampspeed);
+}
+
+void coalescer_stop()
+{
+    int i, s;
+    if (!running)
+        return;
+    pthread_mutex_lock(&lock);
+    running = 0;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&lock);
+    pthread_join(worker, NULL);
+
+    for (i = 0; i < numCwheels; i++) {
+        for (s = 0; s < NUM_COALESCE_SETTINGS; s++) {
+            coalslot *slot = &cwheels[i].slots[s];
+            if (slot->requested) {
+                printf("%s %s: %llu changes requested, %llu commands sent, %llu failed.\n", cwheels[i].wheel->name,
+                       s == COALESCE_RANGE ? "range" : "autocenter", slot->requested, slot->sent, slot->failed);
+            }
+        }
+    }
+    numCwheels = 0;
+    pthread_cond_destroy(&cond);
+}
+
+int run_setting_queue(wheelstruct *w, int interval_ms)
+{
+    char line[128];
+
+    if (coalescer_start(interval_ms) != 0)
+        return -1;
+    if (verbose_flag) printf("Queueing settings for %s from stdin, at most one command per setting every %d ms.\n",
+                             w->name, interval_ms);
+
+    while (fgets(line, sizeof(line), stdin)) {
+        int value, value2;
+        if (sscanf(line, "range %d", &value) == 1) {
+            coalesce_range(w, value);
+        } else if (sscanf(line, "autocenter %d %d", &value, &value2) == 2) {
+            coalesce_autocenter(w, value, value2);
+        } else if (sscanf(line, "autocenter %d", &value) == 1 && value == 0) {
+            coalesce_autocenter(w, 0, 0);
+        } else if (line[0] != '\n') {
+            printf("Unknown setting: %s", line);
+        }
+    }
+    coalescer_stop();
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef coalescer_h
+#define coalescer_h
+
+#include "wheels.h"
+
+#define COALESCE_INTERVAL_MS 50
+#define COALESCE_IDLE_INTERVALS 4        /* release wheel after this many intervals without changes */
+#define COALESCE_MAX_WHEELS 8
+
+#define COALESCE_RANGE 0
+#define COALESCE_AUTOCENTER 1
+#define NUM_COALESCE_SETTINGS 2
+
+/*
+ * Queued setter for settings changing in quick succession (e.g. sliders of a control panel)
+ *
+ * Changes are only queued, a worker thread sends them. Pending changes of the same
+ * wheel and setting collapse to the newest value and every setting is sent at most
+ * once per interval. While changes keep coming the wheel stays claimed, so the
+ * kernel driver is detached and re-attached only once per burst instead of per change.
+ *
+ * The queue functions never wait for USB.
+ */
+int coalescer_start(int interval_ms);
+void coalesce_range(wheelstruct *w, int range);
+void coalesce_autocenter(wheelstruct *w, int centerforce, int rampspeed);
+
+/*
+ * Send what is still pending, release all wheels and stop the worker.
+ */
+void coalescer_stop();
+
+/*
+ * Read settings from stdin, one per line, and queue them for wheel w:
+ *   range <degrees>
+ *   autocenter <centerforce> <rampspeed>
+ * Runs until end of input, then prints how many changes were collapsed.
+ */
+int run_setting_queue(wheelstruct *w, int interval_ms);
+
+#endif
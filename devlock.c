@@ -0,0 +1,302 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "wheels.h"
+#include "devlock.h"
+#include "stats.h"
+
+/* Globals */
+extern int verbose_flag;
+
+typedef struct {
+    char port_path[64];
+    int fd;
+    int depth;                           /* nesting level within this process */
+} devlock;
+
+static devlock locks[MAX_DEVICE_LOCKS];
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Directory for lock files and spools, 0 if there is none we can write to
+ */
+static const char *lock_dir()
+{
+    static int warned = 0;
+    if (access(LOCK_DIR, W_OK) == 0)
+        return LOCK_DIR;
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (dir && dir[0] && access(dir, W_OK) == 0) {
+        if (!warned++)
+            printf("Can not write to " LOCK_DIR ", locking wheels in %s (only against processes of this user).\n",
+                   dir);
+        return dir;
+    }
+    return 0;
+}
+
+static devlock *find_lock(const char *port_path)
+{
+    int i;
+    for (i = 0; i < MAX_DEVICE_LOCKS; i++) {
+        if (locks[i].depth && strcmp(locks[i].port_path, port_path) == 0)
+            return &locks[i];
+    }
+    return 0;
+}
+
+int lock_device(const char *port_path)
+{
+    char file[256];
+    int i;
+
+    devlock *l = find_lock(port_path);
+    if (l) {
+        l->depth++;
+        return 0;
+    }
+    for (i = 0; i < MAX_DEVICE_LOCKS && locks[i].depth; i++)
+        ;
+    if (i == MAX_DEVICE_LOCKS) {
+        printf("Warning: too many wheels locked, going on without lock for %s.\n", port_path);
+        return -1;
+    }
+    l = &locks[i];
+
+    const char *dir = lock_dir();
+    if (!dir) {
+        printf("Warning: no writable lock directory, going on without lock for %s.\n", port_path);
+        return -1;
+    }
+    snprintf(file, sizeof(file), "%.128s/ltwheelconf-%.64s.lock", dir, port_path);
+    // flock only needs a readable file, so lock files created by root work for everybody
+    l->fd = open(file, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (l->fd == -1) {
+        perror(file);
+        printf("Warning: going on without lock for %s.\n", port_path);
+        return -1;
+    }
+    if (flock(l->fd, LOCK_EX | LOCK_NB) != 0) {
+        if (errno != EWOULDBLOCK) {
+            perror("Lock device");
+            printf("Warning: going on without lock for %s.\n", port_path);
+            close(l->fd);
+            return -1;
+        }
+        printf("Waiting for other ltwheelconf using wheel at %s...\n", port_path);
+        long long start = now_ns();
+        while (flock(l->fd, LOCK_EX) != 0) {
+            if (errno != EINTR) {
+                perror("Lock device");
+                printf("Warning: going on without lock for %s.\n", port_path);
+                close(l->fd);
+                return -1;
+            }
+        }
+        static int waits = -1;
+        if (waits < 0)
+            waits = stats_histogram("ltwheelconf_lock_wait_seconds", 0, "Time waited for another process using the same wheel");
+        stats_observe_ns(waits, now_ns() - start);
+    }
+    snprintf(l->port_path, sizeof(l->port_path), "%s", port_path);
+    l->depth = 1;
+    return 0;
+}
+
+void unlock_device(const char *port_path)
+{
+    devlock *l = find_lock(port_path);
+    if (!l || --l->depth)
+        return;
+    flock(l->fd, LOCK_UN);
+    close(l->fd);
+}
+
+/*
+ * Returns -1 if there is no lock directory
+ */
+static int spool_dir(const char *port_path, char *dir, size_t len)
+{
+    const char *base = lock_dir();
+    if (!base)
+        return -1;
+    snprintf(dir, len, "%.128s/ltwheelconf-%.64s.spool", base, port_path);
+    return 0;
+}
+
+int spool_request(const char *port_path, cmdstruct *command, char *name, size_t len)
+{
+    char dir[256], file[512], tmp[512];
+    struct timespec ts;
+
+    if (spool_dir(port_path, dir, sizeof(dir)) != 0)
+        return -1;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        if (verbose_flag) perror(dir);
+        return -1;
+    }
+    // realtime, so names sort by arrival across processes
+    clock_gettime(CLOCK_REALTIME, &ts);
+    snprintf(name, len, "%010lld%09ld-%d", (long long)ts.tv_sec, ts.tv_nsec, getpid());
+    snprintf(file, sizeof(file), "%s/%s.req", dir, name);
+    snprintf(tmp, sizeof(tmp), "%s/%s.tmp", dir, name);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        if (verbose_flag) perror(tmp);
+        return -1;
+    }
+    if (write(fd, command, sizeof(cmdstruct)) != sizeof(cmdstruct)) {
+        if (verbose_flag) perror(tmp);
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    // requests only become visible complete
+    if (rename(tmp, file) != 0) {
+        if (verbose_flag) perror(file);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int spool_result(const char *port_path, const char *name, int *status)
+{
+    char dir[256], file[512];
+
+    if (spool_dir(port_path, dir, sizeof(dir)) != 0)
+        return 0;
+    snprintf(file, sizeof(file), "%s/%s.done", dir, name);
+    FILE *f = fopen(file, "r");
+    if (!f)
+        return 0;
+    if (fscanf(f, "%d", status) != 1)
+        *status = -1;
+    fclose(f);
+    unlink(file);
+    return 1;
+}
+
+/*
+ * Request names end with the pid of their owner
+ */
+static int owner_alive(const char *name)
+{
+    const char *dash = strrchr(name, '-');
+    int pid = dash ? atoi(dash + 1) : 0;
+    return pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+int spool_next(const char *port_path, char *name, size_t len, cmdstruct *command)
+{
+    char dir[256], file[512], oldest[128];
+    struct dirent *entry;
+
+    if (spool_dir(port_path, dir, sizeof(dir)) != 0)
+        return 0;
+    DIR *d = opendir(dir);
+    if (!d)
+        return 0;
+    oldest[0] = 0;
+    while ((entry = readdir(d))) {
+        size_t n = strlen(entry->d_name);
+        int request = n >= 5 && strcmp(entry->d_name + n - 4, ".req") == 0;
+        int other = (n >= 6 && strcmp(entry->d_name + n - 5, ".done") == 0)
+                    || (n >= 5 && strcmp(entry->d_name + n - 4, ".tmp") == 0);
+        if ((!request && !other) || n >= sizeof(oldest))
+            continue;
+        if (!owner_alive(entry->d_name)) {
+            // owner was killed while waiting: its command must not reach the wheel any more,
+            // and nobody is going to pick up its result or finish writing its request
+            snprintf(file, sizeof(file), "%s/%.127s", dir, entry->d_name);
+            unlink(file);
+            if (verbose_flag && request) printf("Dropping request %s, its process is gone.\n", entry->d_name);
+            continue;
+        }
+        if (!request)
+            continue;
+        if (!oldest[0] || strcmp(entry->d_name, oldest) < 0)
+            snprintf(oldest, sizeof(oldest), "%.127s", entry->d_name);
+    }
+    closedir(d);
+    if (!oldest[0])
+        return 0;
+
+    snprintf(file, sizeof(file), "%s/%s", dir, oldest);
+    snprintf(name, len, "%.*s", (int)strlen(oldest) - 4, oldest);
+    int fd = open(file, O_RDONLY);
+    if (fd == -1 || read(fd, command, sizeof(cmdstruct)) != sizeof(cmdstruct)
+        || command->numCmds > sizeof(command->cmds) / sizeof(command->cmds[0])) {
+        // broken request, report failure to its owner
+        if (fd != -1) close(fd);
+        spool_finish(port_path, name, -1);
+        return spool_next(port_path, name, len, command);
+    }
+    close(fd);
+    return 1;
+}
+
+void spool_finish(const char *port_path, const char *name, int status)
+{
+    char dir[256], file[512], done[512];
+
+    if (spool_dir(port_path, dir, sizeof(dir)) != 0)
+        return;
+    snprintf(file, sizeof(file), "%s/%s.req", dir, name);
+    snprintf(done, sizeof(done), "%s/%s.done", dir, name);
+    FILE *f = fopen(file, "w");
+    if (f) {
+        fprintf(f, "%d\n", status);
+        fclose(f);
+    }
+    // owner only looks for .done, so it never sees the request half rewritten
+    if (rename(file, done) != 0)
+        unlink(file);
+}
+
+void spool_cancel(const char *port_path, const char *name)
+{
+    char dir[256], file[512];
+
+    if (spool_dir(port_path, dir, sizeof(dir)) != 0)
+        return;
+    snprintf(file, sizeof(file), "%s/%s.req", dir, name);
+    unlink(file);
+}
@@ -0,0 +1,85 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef devlock_h
+#define devlock_h
+
+#include <stddef.h>
+
+#include "wheels.h"
+
+#define LOCK_DIR "/run/lock"
+#define MAX_DEVICE_LOCKS 8
+
+/*
+ * Advisory per wheel lock (flock on LOCK_DIR/ltwheelconf-<port path>.lock), taken
+ * while the kernel driver is detached, so concurrent ltwheelconf processes (e.g.
+ * one started by udev and one by the user) do not interleave detach, claim and
+ * commands on the same wheel.
+ *
+ * If LOCK_DIR is not writable (e.g. for a normal user) the lock is taken in
+ * $XDG_RUNTIME_DIR instead, which only keeps processes of the same user apart.
+ *
+ * lock_device() waits until the lock is free. Within one process locks nest,
+ * only the outermost unlock_device() releases the lock.
+ * Returns 0 if locked, -1 if no lock could be taken: callers go on unlocked (a
+ * warning is printed) and must not call unlock_device() then.
+ */
+int lock_device(const char *port_path);
+void unlock_device(const char *port_path);
+
+/*
+ * Request spool: while waiting for the lock a process leaves its command in
+ * ltwheelconf-<port path>.spool next to the lock file. The process holding the lock sends all
+ * spooled commands in its claim session and leaves the result for their owners,
+ * so concurrent requests are merged instead of each detaching the driver again.
+ * Request names end with the pid of the owner: requests and results of processes
+ * which are gone are removed instead of being sent.
+ */
+
+/*
+ * Spool command, name receives the request name. Returns -1 on failure.
+ */
+int spool_request(const char *port_path, cmdstruct *command, char *name, size_t len);
+
+/*
+ * Check if request was sent by another process. Returns 1 and stores the result
+ * of send_command_claimed() in status if it was (the request is removed then),
+ * 0 if it is still pending.
+ */
+int spool_result(const char *port_path, const char *name, int *status);
+
+/*
+ * Oldest pending request. Requests and results of owners which are gone are removed.
+ * Returns 1 if one was found, 0 if the spool is empty.
+ */
+int spool_next(const char *port_path, char *name, size_t len, cmdstruct *command);
+
+/*
+ * Mark request as sent with given status
+ */
+void spool_finish(const char *port_path, const char *name, int status);
+
+/*
+ * Withdraw own request (e.g. when sending it directly)
+ */
+void spool_cancel(const char *port_path, const char *name);
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include <linux/input.h>
+
+#include "wheels.h"
+#include "wheelfunctions.h"
+#include "recording.h"
+#include "shifter.h"
+#include "export.h"
+
+/* Globals */
+extern int verbose_flag;
+
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+
+typedef struct {
+    int fd;
+    int numAxes;
+    unsigned short codes[ABS_CNT];
+    float scale[ABS_CNT];
+    float offset[ABS_CNT];
+    const unsigned short *gearCodes;     /* 0 if no gear column */
+    long long *time;
+    int *raw;                            /* numAxes columns of COL_CHUNK_ROWS raw axis values */
+    float *converted;
+    signed char *gear;
+    unsigned int rows;
+    unsigned long long totalRows;
+    unsigned long long bytes;
+} colwriter;
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void axis_name(int code, char *name, size_t len)
+{
+    static const char *names[ABS_CNT] = {
+        [ABS_X] = "ABS_X", [ABS_Y] = "ABS_Y", [ABS_Z] = "ABS_Z",
+        [ABS_RX] = "ABS_RX", [ABS_RY] = "ABS_RY", [ABS_RZ] = "ABS_RZ",
+        [ABS_THROTTLE] = "ABS_THROTTLE", [ABS_RUDDER] = "ABS_RUDDER", [ABS_WHEEL] = "ABS_WHEEL",
+        [ABS_GAS] = "ABS_GAS", [ABS_BRAKE] = "ABS_BRAKE",
+        [ABS_HAT0X] = "ABS_HAT0X", [ABS_HAT0Y] = "ABS_HAT0Y"
+    };
+    if (names[code])
+        snprintf(name, len, "%s", names[code]);
+    else
+        snprintf(name, len, "ABS_%d", code);
+}
+
+/*
+ * out = in * scale + offset, four values at a time
+ */
+static void convert_column(const int *in, float *out, unsigned int n, float scale, float offset)
+{
+    v4sf s = { scale, scale, scale, scale };
+    v4sf o = { offset, offset, offset, offset };
+    unsigned int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        v4si x;
+        memcpy(&x, in + i, sizeof(x));
+        v4sf f = __builtin_convertvector(x, v4sf) * s + o;
+        memcpy(out + i, &f, sizeof(f));
+    }
+    for (; i < n; i++)
+        out[i] = in[i] * scale + offset;
+}
+
+static int flush_chunk(colwriter *w)
+{
+    static const unsigned char pad[8] = { 0 };
+    struct iovec iov[2 * ABS_CNT + 4];
+    int numIov = 0;
+    colchunk chunk;
+    size_t total = 0;
+    int a;
+
+    if (!w->rows)
+        return 0;
+    chunk.magic = COL_CHUNK_MAGIC;
+    chunk.rows = w->rows;
+
+#define ADD_IOV(ptr, len) { iov[numIov].iov_base = (void *)(ptr); iov[numIov].iov_len = (len); total += (len); numIov++; }
+    ADD_IOV(&chunk, sizeof(chunk));
+    ADD_IOV(w->time, w->rows * sizeof(long long));
+    for (a = 0; a < w->numAxes; a++) {
+        float *out = w->converted + (size_t)a * COL_CHUNK_ROWS;
+        convert_column(w->raw + (size_t)a * COL_CHUNK_ROWS, out, w->rows, w->scale[a], w->offset[a]);
+        ADD_IOV(out, w->rows * sizeof(float));
+        if (w->rows % 2)
+            ADD_IOV(pad, 4);
+    }
+    if (w->gearCodes) {
+        ADD_IOV(w->gear, w->rows);
+        if (w->rows % 8)
+            ADD_IOV(pad, 8 - w->rows % 8);
+    }
+#undef ADD_IOV
+
+    if (writev(w->fd, iov, numIov) != (ssize_t)total) {
+        perror("Write chunk");
+        return -1;
+    }
+    w->bytes += total;
+    w->totalRows += w->rows;
+    w->rows = 0;
+    return 0;
+}
+
+int export_recording(char *recording_file, char *output_file, wheelstruct *w, int range)
+{
+    recording rec;
+    reccursor cur;
+    recsample sample;
+    colwriter cw;
+    colheader header;
+    colcolumn columns[ABS_CNT + 2];
+    int axisIndex[ABS_CNT];
+    int state[ABS_CNT];
+    unsigned int pressed = 0;
+    int code, a, i;
+
+    if (recording_open(recording_file, &rec) != 0)
+        return -1;
+    devcaps *caps = &rec.header->caps;
+    if (!w)
+        w = find_wheel_by_pid(caps->id.product);
+    if (range <= 0)
+        range = w ? w->max_rotation : 900;
+
+    memset(&cw, 0, sizeof(cw));
+    memset(&header, 0, sizeof(header));
+    memset(columns, 0, sizeof(columns));
+    int numColumns = 0;
+
+    snprintf(columns[numColumns].name, sizeof(columns[0].name), "time_us");
+    columns[numColumns++].type = COL_INT64;
+
+    // ABS_X (steering) is code 0, so it always becomes the first axis column
+    for (code = 0; code < ABS_CNT; code++)
+        axisIndex[code] = -1;
+    for (code = 0; code < ABS_CNT; code++) {
+        if (!caps_test_bit(EV_ABS, caps->evbits) || !caps_test_bit(code, caps->absbits))
+            continue;
+        struct input_absinfo *ai = &caps->absinfo[code];
+        float span = ai->maximum - ai->minimum;
+        a = cw.numAxes++;
+        axisIndex[code] = a;
+        cw.codes[a] = code;
+        state[a] = ai->value;
+        if (code == ABS_X) {
+            cw.scale[a] = span > 0 ? range / span : 0;
+            cw.offset[a] = -(ai->minimum + span / 2) * cw.scale[a];
+            snprintf(columns[numColumns].name, sizeof(columns[0].name), "steering_deg");
+        } else {
+            cw.scale[a] = span > 0 ? 1 / span : 0;
+            cw.offset[a] = -ai->minimum * cw.scale[a];
+            axis_name(code, columns[numColumns].name, sizeof(columns[0].name));
+        }
+        columns[numColumns++].type = COL_FLOAT32;
+    }
+
+    // gear column, if the recorded device has the shifter buttons
+    cw.gearCodes = w ? get_gear_codes(w) : 0;
+    if (cw.gearCodes) {
+        for (i = 0; i <= NUM_GEARS; i++) {
+            if (!caps_test_bit(cw.gearCodes[i], caps->keybits))
+                cw.gearCodes = 0;
+        }
+    }
+    if (cw.gearCodes) {
+        snprintf(columns[numColumns].name, sizeof(columns[0].name), "gear");
+        columns[numColumns++].type = COL_INT8;
+    }
+
+    cw.time = malloc(COL_CHUNK_ROWS * sizeof(long long));
+    cw.raw = malloc((size_t)(cw.numAxes ? cw.numAxes : 1) * COL_CHUNK_ROWS * sizeof(int));
+    cw.converted = malloc((size_t)(cw.numAxes ? cw.numAxes : 1) * COL_CHUNK_ROWS * sizeof(float));
+    cw.gear = malloc(COL_CHUNK_ROWS);
+    if (!cw.time || !cw.raw || !cw.converted || !cw.gear) {
+        perror("Allocate export buffers");
+        goto fail;
+    }
+
+    cw.fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (cw.fd == -1) {
+        perror(output_file);
+        goto fail;
+    }
+    memcpy(header.magic, COL_MAGIC, sizeof(header.magic));
+    header.version = COL_VERSION;
+    header.numColumns = numColumns;
+    header.chunkRows = COL_CHUNK_ROWS;
+    header.start_realtime_us = rec.header->start_realtime_us;
+    if (write(cw.fd, &header, sizeof(header)) != sizeof(header)
+        || write(cw.fd, columns, numColumns * sizeof(colcolumn)) != numColumns * sizeof(colcolumn)) {
+        perror(output_file);
+        goto fail;
+    }
+    cw.bytes = sizeof(header) + numColumns * sizeof(colcolumn);
+
+    long long start = now_ns();
+    unsigned long long samples = 0;
+    recording_seek(&rec, &cur, 0);
+    while (recording_next(&cur, &sample)) {
+        samples++;
+        if (sample.type == EV_ABS && sample.code < ABS_CNT && axisIndex[sample.code] >= 0) {
+            state[axisIndex[sample.code]] = sample.value;
+        } else if (sample.type == EV_KEY && cw.gearCodes) {
+            for (i = 0; i <= NUM_GEARS; i++) {
+                if (sample.code != cw.gearCodes[i])
+                    continue;
+                if (sample.value)
+                    pressed |= 1 << i;
+                else
+                    pressed &= ~(1 << i);
+            }
+        } else if (sample.type == EV_SYN && sample.code == SYN_REPORT) {
+            unsigned int row = cw.rows++;
+            cw.time[row] = sample.us;
+            for (a = 0; a < cw.numAxes; a++)
+                cw.raw[(size_t)a * COL_CHUNK_ROWS + row] = state[a];
+            cw.gear[row] = decode_gear(pressed);
+            if (cw.rows == COL_CHUNK_ROWS && flush_chunk(&cw) != 0)
+                goto fail;
+        }
+    }
+    if (flush_chunk(&cw) != 0)
+        goto fail;
+    double seconds = (now_ns() - start) / 1e9;
+
+    printf("Exported %llu samples into %llu rows of %d columns (%s, range %d degrees), %llu bytes in %.2f s",
+           samples, cw.totalRows, numColumns, w ? w->name : "unknown wheel", range, cw.bytes, seconds);
+    if (seconds > 0)
+        printf(" (%.0f rows/s)", cw.totalRows / seconds);
+    printf(".\n");
+    if (verbose_flag) {
+        for (i = 0; i < numColumns; i++)
+            printf("  column %d: %s\n", i, columns[i].name);
+    }
+
+    close(cw.fd);
+    free(cw.time);
+    free(cw.raw);
+    free(cw.converted);
+    free(cw.gear);
+    recording_close(&rec);
+    return 0;
+
+fail:
+    if (cw.fd > 0) close(cw.fd);
+    free(cw.time);
+    free(cw.raw);
+    free(cw.converted);
+    free(cw.gear);
+    recording_close(&rec);
+    return -1;
+}
@@ -0,0 +1,80 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef export_h
+#define export_h
+
+#include "wheels.h"
+
+/*
+ * Columnar export file format
+ *
+ * The file starts with a colheader and numColumns colcolumn descriptions,
+ * followed by chunks. Every chunk has a colchunk header and then the values of
+ * every column for all rows of the chunk, column after column, each column
+ * padded to a multiple of 8 bytes. Values are little endian. A column can be read
+ * straight into an array (e.g. numpy.frombuffer) without touching the others.
+ *
+ * There is one row per input frame (SYN_REPORT), holding the state of all axes
+ * after that frame:
+ *  time_us        int64    microseconds since start of the recording
+ *  steering_deg   float32  ABS_X scaled to the rotation range, 0 is center
+ *  <axis>         float32  every other axis scaled to 0..1 of its range (pedals)
+ *  gear           int8     -1 reverse, 0 neutral, 1..6, if the wheel has an H-shifter
+ */
+
+#define COL_MAGIC "LTWCOL1"
+#define COL_VERSION 1
+#define COL_CHUNK_MAGIC 0x314b4843       /* "CHK1" */
+#define COL_CHUNK_ROWS 65536
+
+#define COL_INT64 1
+#define COL_FLOAT32 2
+#define COL_INT8 3
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int numColumns;
+    unsigned int chunkRows;              /* maximum rows per chunk */
+    unsigned int reserved;
+    long long start_realtime_us;         /* wall clock time the recording started */
+} colheader;
+
+typedef struct {
+    char name[24];
+    unsigned int type;
+    unsigned int reserved;
+} colcolumn;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int rows;
+} colchunk;
+
+/*
+ * Convert recording (see recording.h) into a columnar file.
+ * Wheel and range are used for steering_deg and gear; if w is 0 the wheel is
+ * found by the product id of the recording, range <= 0 uses the wheel's maximum.
+ * Memory use is independent of the length of the recording.
+ */
+int export_recording(char *recording_file, char *output_file, wheelstruct *w, int range);
+
+#endif
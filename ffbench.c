@@ -0,0 +1,418 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <math.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include <linux/input.h>
+
+#include "wheels.h"
+#include "wheelfunctions.h"
+#include "stats.h"
+#include "ffbench.h"
+
+/* Globals */
+extern int verbose_flag;
+
+#define REST_WINDOW_MS 200
+#define REST_TIMEOUT_MS 3000
+
+/* autocenter settings (centerforce, rampspeed) benchmarked by default */
+static const int sweep[][2] = {
+    { 64, 0 }, { 64, 3 }, { 64, 7 },
+    { 128, 0 }, { 128, 3 }, { 128, 7 },
+    { 255, 0 }, { 255, 3 }, { 255, 7 },
+    { 0, 0 }                             /* last, leaves autocenter off like hid-lg4ff does */
+};
+
+typedef struct {
+    long long ts;
+    int x;
+} possample;
+
+typedef struct {
+    int fd;
+    struct input_absinfo abs;
+    int pos;                             /* latest ABS_X */
+    possample samples[FFBENCH_MAX_SAMPLES];
+    int numSamples;
+    int writes;                          /* metric id of event device write times */
+} benchdev;
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static long long median(long long *values, int num)
+{
+    if (!num)
+        return -1;
+    qsort(values, num, sizeof(long long), cmp_ll);
+    return values[num / 2];
+}
+
+/*
+ * Read input until time until, recording ABS_X changes. Polls at least once.
+ */
+static int read_positions(benchdev *d, long long until)
+{
+    struct pollfd pfd;
+    pfd.fd = d->fd;
+    pfd.events = POLLIN;
+
+    do {
+        long long left = until - now_ns();
+        int ret = poll(&pfd, 1, left > 0 ? (left + 999999) / 1000000 : 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return -1;
+        }
+        if (ret == 0)
+            continue;
+
+        struct input_event ev[64];
+        ssize_t len = read(d->fd, ev, sizeof(ev));
+        if (len <= 0) {
+            if (len < 0) perror("Read device");
+            return -1;
+        }
+        int numEvents = len / sizeof(struct input_event);
+        int e;
+        for (e = 0; e < numEvents; e++) {
+            if (ev[e].type != EV_ABS || ev[e].code != ABS_X)
+                continue;
+            d->pos = ev[e].value;
+            if (d->numSamples < FFBENCH_MAX_SAMPLES) {
+                d->samples[d->numSamples].ts = (long long)ev[e].time.tv_sec * 1000000000LL + ev[e].time.tv_usec * 1000LL;
+                d->samples[d->numSamples].x = ev[e].value;
+                d->numSamples++;
+            }
+        }
+    } while (now_ns() < until);
+    return 0;
+}
+
+/*
+ * Wait until the wheel did not move for REST_WINDOW_MS
+ */
+static int wait_rest(benchdev *d)
+{
+    int range = d->abs.maximum - d->abs.minimum;
+    int tolerance = d->abs.fuzz > range / 500 ? d->abs.fuzz : range / 500;
+    long long timeout = now_ns() + REST_TIMEOUT_MS * 1000000LL;
+
+    while (now_ns() < timeout) {
+        int i, lo = d->pos, hi = d->pos;
+        d->numSamples = 0;
+        if (read_positions(d, now_ns() + REST_WINDOW_MS * 1000000LL) != 0)
+            return -1;
+        for (i = 0; i < d->numSamples; i++) {
+            if (d->samples[i].x < lo) lo = d->samples[i].x;
+            if (d->samples[i].x > hi) hi = d->samples[i].x;
+        }
+        if (hi - lo <= tolerance)
+            return 0;
+    }
+    if (verbose_flag) printf("Wheel did not come to rest, measuring anyway.\n");
+    return 0;
+}
+
+static int play(benchdev *d, int id, int value)
+{
+    struct input_event ie;
+    memset(&ie, 0, sizeof(ie));
+    ie.type = EV_FF;
+    ie.code = id;
+    ie.value = value;
+    if (write(d->fd, &ie, sizeof(ie)) == -1) {
+        perror("Play force feedback effect");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Apply constant force step, measure latency until the wheel moves and rise time.
+ * Latency and rise are -1 if the wheel did not move.
+ */
+static int step_test(benchdev *d, struct ff_effect *effect, int level, long long *latency, long long *rise)
+{
+    int range = d->abs.maximum - d->abs.minimum;
+    int threshold = range / 200 > d->abs.fuzz ? range / 200 : d->abs.fuzz + 1;
+    int i;
+
+    if (wait_rest(d) != 0)
+        return -1;
+    int p0 = d->pos;
+
+    effect->u.constant.level = level;
+    if (ioctl(d->fd, EVIOCSFF, effect) < 0) {
+        perror("Upload constant force");
+        return -1;
+    }
+    d->numSamples = 0;
+    long long t0 = now_ns();
+    if (play(d, effect->id, 1) != 0)
+        return -1;
+    if (read_positions(d, t0 + FFBENCH_STEP_MS * 1000000LL) != 0)
+        return -1;
+    play(d, effect->id, 0);
+
+    *latency = -1;
+    *rise = -1;
+    int moved = -1;
+    for (i = 0; i < d->numSamples; i++) {
+        if (abs(d->samples[i].x - p0) >= threshold) {
+            moved = i;
+            break;
+        }
+    }
+    if (moved < 0)
+        return 0;
+    *latency = d->samples[moved].ts - t0;
+
+    // rise time: 10% to 90% of the displacement reached at the end of the step
+    int total = abs(d->samples[d->numSamples - 1].x - p0);
+    long long t10 = -1, t90 = -1;
+    for (i = 0; i < d->numSamples; i++) {
+        int disp = abs(d->samples[i].x - p0);
+        if (t10 < 0 && disp * 10 >= total)
+            t10 = d->samples[i].ts;
+        if (t90 < 0 && disp * 10 >= total * 9) {
+            t90 = d->samples[i].ts;
+            break;
+        }
+    }
+    if (t10 >= 0 && t90 >= 0)
+        *rise = t90 - t10;
+    return 0;
+}
+
+/*
+ * Update effect level along a sine as fast as the driver accepts it
+ */
+static int sine_test(benchdev *d, struct ff_effect *effect, double *rate, long long *update_ns, int *amplitude)
+{
+    unsigned long long updates = 0;
+    long long updateSum = 0;
+    int i;
+
+    if (wait_rest(d) != 0)
+        return -1;
+    int lo = d->pos, hi = d->pos;
+    effect->u.constant.level = 0;
+    if (ioctl(d->fd, EVIOCSFF, effect) < 0 || play(d, effect->id, 1) != 0) {
+        perror("Start sine");
+        return -1;
+    }
+
+    long long start = now_ns();
+    long long end = start + FFBENCH_SINE_SEC * 1000000000LL;
+    long long now = start;
+    while (now < end) {
+        effect->u.constant.level = FFBENCH_LEVEL * sin(2 * M_PI * FFBENCH_SINE_HZ * (now - start) / 1e9);
+        long long t = now_ns();
+        if (ioctl(d->fd, EVIOCSFF, effect) < 0) {
+            perror("Update constant force");
+            break;
+        }
+        now = now_ns();
+        stats_observe_ns(d->writes, now - t);
+        updateSum += now - t;
+        updates++;
+
+        d->numSamples = 0;
+        if (read_positions(d, 0) != 0)
+            break;
+        // ignore the first period while the motion builds up
+        if (now - start > 1000000000LL / FFBENCH_SINE_HZ) {
+            for (i = 0; i < d->numSamples; i++) {
+                if (d->samples[i].x < lo) lo = d->samples[i].x;
+                if (d->samples[i].x > hi) hi = d->samples[i].x;
+            }
+        }
+    }
+    play(d, effect->id, 0);
+
+    double seconds = (now_ns() - start) / 1e9;
+    *rate = updates / seconds;
+    *update_ns = updates ? updateSum / (long long)updates : 0;
+    *amplitude = hi - lo;
+    return 0;
+}
+
+static int set_bench_autocenter(wheelstruct *w, int hidfd, int centerforce, int rampspeed)
+{
+    cmdstruct c;
+    memset(&c, 0, sizeof(c));
+    w->get_autocenter_cmd(&c, centerforce, rampspeed);
+    return send_command_hidraw(hidfd, c);
+}
+
+static void bench_setting(wheelstruct *w, benchdev *d, struct ff_effect *effect, int centerforce, int rampspeed)
+{
+    long long latencies[2 * FFBENCH_STEPS], rises[2 * FFBENCH_STEPS];
+    int numLatencies = 0, numRises = 0, steps = 0;
+    long long latencyMax = 0;
+    int i;
+
+    for (i = 0; i < 2 * FFBENCH_STEPS; i++) {
+        long long latency, rise;
+        if (step_test(d, effect, (i % 2) ? -FFBENCH_LEVEL : FFBENCH_LEVEL, &latency, &rise) != 0)
+            return;
+        steps++;
+        if (latency >= 0) {
+            latencies[numLatencies++] = latency;
+            if (latency > latencyMax)
+                latencyMax = latency;
+        }
+        if (rise >= 0)
+            rises[numRises++] = rise;
+        if (verbose_flag) printf("  step %d: latency %lld us, rise %lld us\n", i, latency / 1000, rise / 1000);
+    }
+
+    double rate = 0;
+    long long update_ns = 0;
+    int amplitude = 0;
+    if (sine_test(d, effect, &rate, &update_ns, &amplitude) != 0)
+        return;
+
+    int range = d->abs.maximum - d->abs.minimum;
+    long long latency = median(latencies, numLatencies);
+    long long rise = median(rises, numRises);
+    if (centerforce >= 0)
+        printf("%-6s %6d %4d", w->shortname, centerforce, rampspeed);
+    else
+        printf("%-6s %6s %4s", w->shortname, "-", "-");
+    printf(" %5d/%-2d %8.1f %8.1f %8.1f %9.0f %8lld %7.1f\n", numLatencies, steps,
+           latency >= 0 ? latency / 1e6 : -1.0, latencyMax / 1e6, rise >= 0 ? rise / 1e6 : -1.0,
+           rate, update_ns / 1000, range > 0 ? 100.0 * amplitude / range : 0.0);
+}
+
+int run_ffbench(wheelstruct *w, char *device_file_name, int centerforce, int rampspeed)
+{
+    unsigned char ffbits[FF_CNT / 8 + 1];
+    struct ff_effect effect;
+    benchdev *d;
+    int clk = CLOCK_MONOTONIC;
+    int i;
+
+    d = calloc(1, sizeof(benchdev));
+    if (!d) {
+        perror("Allocate benchmark buffer");
+        return -1;
+    }
+    d->fd = open(device_file_name, O_RDWR);
+    if (d->fd == -1) {
+        perror("Open device file");
+        free(d);
+        return -1;
+    }
+    memset(ffbits, 0, sizeof(ffbits));
+    if (ioctl(d->fd, EVIOCGBIT(EV_FF, sizeof(ffbits)), ffbits) < 0 || !(ffbits[FF_CONSTANT / 8] & (1 << (FF_CONSTANT % 8)))) {
+        printf("%s does not support constant force effects.\n", device_file_name);
+        close(d->fd);
+        free(d);
+        return -1;
+    }
+    if (ioctl(d->fd, EVIOCGABS(ABS_X), &d->abs) < 0) {
+        perror("Get wheel axis");
+        close(d->fd);
+        free(d);
+        return -1;
+    }
+    if (ioctl(d->fd, EVIOCSCLOCKID, &clk) != 0)
+        perror("Switch to monotonic timestamps");
+    d->pos = d->abs.value;
+    d->writes = evdev_write_stats("ffbench");
+
+    memset(&effect, 0, sizeof(effect));
+    effect.type = FF_CONSTANT;
+    effect.id = -1;
+    effect.direction = 0x4000;
+    effect.replay.length = 0;            // play until stopped
+    if (ioctl(d->fd, EVIOCSFF, &effect) < 0) {
+        perror("Upload constant force");
+        close(d->fd);
+        free(d);
+        return -1;
+    }
+
+    // full gain, so results of different runs compare
+    struct input_event ie;
+    memset(&ie, 0, sizeof(ie));
+    ie.type = EV_FF;
+    ie.code = FF_GAIN;
+    ie.value = 0xffff;
+    if (write(d->fd, &ie, sizeof(ie)) == -1)
+        perror("Set gain");
+
+    int hidfd = w->get_autocenter_cmd ? open_wheel_hidraw(w) : -1;
+    int sweeping = centerforce < 0;
+    if (hidfd == -1) {
+        printf("Can not send autocenter settings to %s without a hidraw node, measuring current setting only.\n",
+               w->name);
+        sweeping = 0;
+        centerforce = -1;
+    }
+
+    printf("Force feedback benchmark of %s on %s, ABS_X range %d..%d, step level %d, sine %d Hz.\n", w->name,
+           device_file_name, d->abs.minimum, d->abs.maximum, FFBENCH_LEVEL, FFBENCH_SINE_HZ);
+    printf("Keep hands off the wheel.\n");
+    printf("%-6s %6s %4s %8s %8s %8s %8s %9s %8s %7s\n", "wheel", "center", "ramp", "moved", "lat[ms]", "max[ms]",
+           "rise[ms]", "upd[1/s]", "upd[us]", "amp[%]");
+
+    int numSettings = sweeping ? sizeof(sweep) / sizeof(sweep[0]) : 1;
+    for (i = 0; i < numSettings; i++) {
+        int force = sweeping ? sweep[i][0] : centerforce;
+        int ramp = sweeping ? sweep[i][1] : rampspeed;
+        if (force >= 0 && set_bench_autocenter(w, hidfd, force, force ? ramp : 0) != 0)
+            break;
+        bench_setting(w, d, &effect, force, force ? ramp : 0);
+    }
+    if (sweeping)
+        printf("Autocenter of %s is left off.\n", w->name);
+
+    ioctl(d->fd, EVIOCRMFF, effect.id);
+    if (hidfd != -1)
+        close(hidfd);
+    close(d->fd);
+    free(d);
+    return 0;
+}
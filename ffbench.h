@@ -0,0 +1,51 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ffbench_h
+#define ffbench_h
+
+#include "wheels.h"
+
+#define FFBENCH_STEPS 4                  /* steps per direction and autocenter setting */
+#define FFBENCH_STEP_MS 300              /* how long a step is applied */
+#define FFBENCH_LEVEL 0x3000             /* constant force level used for steps and sine amplitude */
+#define FFBENCH_SINE_HZ 2
+#define FFBENCH_SINE_SEC 2
+#define FFBENCH_MAX_SAMPLES 4096
+
+/*
+ * Force feedback response benchmark
+ *
+ * Uploads FF_CONSTANT effects through the event device and follows the wheel
+ * position (ABS_X) from the input reports:
+ *  - steps (alternating left and right): latency from playing the effect until
+ *    the wheel moves (0.5% of its range) and 10-90% rise time of the displacement
+ *  - sine: the effect level is updated as fast as the driver accepts it, giving the
+ *    achievable update rate and the resulting position amplitude
+ *
+ * Runs for every autocenter setting in a fixed sweep of centerforce and rampspeed
+ * (or only the one given, if centerforce >= 0). Settings are sent through hidraw, so
+ * the event device stays open. Prints one report line per setting.
+ *
+ * The wheel must be free to turn during the benchmark.
+ */
+int run_ffbench(wheelstruct *w, char *device_file_name, int centerforce, int rampspeed);
+
+#endif
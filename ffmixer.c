@@ -0,0 +1,504 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE                      /* ppoll */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <grp.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <linux/input.h>
+
+#include "inventory.h"
+#include "ffmixer.h"
+#include "wheelfunctions.h"
+#include "stats.h"
+
+/* Globals */
+extern int verbose_flag;
+
+#define NUM_PARAMS 3                     /* constant, autocenter, gain */
+
+typedef struct {
+    int pid;
+    int constant;
+    int autocenter;                      /* -1 if not requested */
+    int gain;                            /* -1 if not requested */
+} ffclient;
+
+typedef struct {
+    int dirty;
+    int value;                           /* combined value waiting to be sent */
+    int sent;                            /* last value written to the device */
+    long long pending_since;             /* receive time of oldest update not yet sent */
+} ffparam;
+
+static volatile sig_atomic_t stop_mixer = 0;
+
+static void handle_stop(int sig)
+{
+    stop_mixer = 1;
+}
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int socket_path(char *device_file_name, struct sockaddr_un *addr)
+{
+    char key[256];
+    int fd = open(device_file_name, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    int ret = get_evdev_key(fd, key, sizeof(key));
+    close(fd);
+    if (ret != 0)
+        return -1;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path, sizeof(addr->sun_path), RUN_DIR "/ffmixer-%.80s", key);
+    return 0;
+}
+
+static int send_message(char *device_file_name, int client, int type, int value)
+{
+    struct sockaddr_un addr;
+    ffmixmsg msg;
+
+    if (socket_path(device_file_name, &addr) != 0)
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd == -1)
+        return -1;
+    msg.client = client;
+    msg.type = type;
+    msg.value = value;
+    int ret = sendto(fd, &msg, sizeof(msg), 0, (struct sockaddr *)&addr, sizeof(addr));
+    close(fd);
+    if (ret != sizeof(msg))
+        return -1;
+    if (verbose_flag) printf("Handed force feedback update to mixer %s.\n", addr.sun_path);
+    return 0;
+}
+
+int ffmixer_send(char *device_file_name, int type, int value)
+{
+    return send_message(device_file_name, getpid(), type, value);
+}
+
+int ffmixer_configure(char *device_file_name, int type, int value)
+{
+    return send_message(device_file_name, FFMIX_CONFIG_CLIENT, type, value);
+}
+
+/*
+ * Receive message, pid receives the pid of the sender as vouched for by the kernel.
+ * Returns -1 if there is no (valid) message.
+ */
+static int recv_message(int sock, ffmixmsg *msg, int *pid)
+{
+    char control[CMSG_SPACE(sizeof(struct ucred))];
+    struct iovec iov = { msg, sizeof(*msg) };
+    struct msghdr mh;
+    struct cmsghdr *cm;
+
+    for (;;) {
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &mh, MSG_DONTWAIT) != sizeof(*msg))
+            return -1;
+        *pid = 0;
+        for (cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_CREDENTIALS)
+                *pid = ((struct ucred *)CMSG_DATA(cm))->pid;
+        }
+        if (*pid > 0)
+            return 0;
+        if (verbose_flag) printf("Ignoring mixer message without credentials.\n");
+    }
+}
+
+/*
+ * Find the interval of the interrupt OUT endpoint in sysfs,
+ * e.g. /sys/class/input/event5/device/device/../ep_01/interval reads "2ms"
+ */
+static long long endpoint_interval_ns(char *device_file_name)
+{
+    char path[512];
+    char buf[32];
+    const char *node = strrchr(device_file_name, '/');
+    node = node ? node + 1 : device_file_name;
+
+    snprintf(path, sizeof(path), "/sys/class/input/%s/device/device/../ep_01/interval", node);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return FFMIXER_DEFAULT_SLOT_US * 1000LL;
+    long long ns = FFMIXER_DEFAULT_SLOT_US * 1000LL;
+    if (fgets(buf, sizeof(buf), f)) {
+        char *unit;
+        long value = strtol(buf, &unit, 10);
+        if (value > 0 && strncmp(unit, "ms", 2) == 0)
+            ns = value * 1000000LL;
+        else if (value > 0 && strncmp(unit, "us", 2) == 0)
+            ns = value * 1000LL;
+    }
+    fclose(f);
+    return ns;
+}
+
+static ffclient *find_client(ffclient *clients, int pid, int create)
+{
+    int i;
+    for (i = 0; i < FFMIXER_MAX_CLIENTS; i++) {
+        if (clients[i].pid == pid)
+            return &clients[i];
+    }
+    if (!create)
+        return 0;
+    for (i = 0; i < FFMIXER_MAX_CLIENTS; i++) {
+        if (!clients[i].pid) {
+            clients[i].pid = pid;
+            clients[i].constant = 0;
+            clients[i].autocenter = -1;
+            clients[i].gain = -1;
+            return &clients[i];
+        }
+    }
+    return 0;
+}
+
+/*
+ * Drop clients which exited without releasing their contributions.
+ * Returns number of clients dropped.
+ */
+static int prune_clients(ffclient *clients)
+{
+    int pruned = 0;
+    int i;
+    for (i = 0; i < FFMIXER_MAX_CLIENTS; i++) {
+        if (clients[i].pid && kill(clients[i].pid, 0) == -1 && errno == ESRCH) {
+            if (verbose_flag) printf("Mixer client %d is gone, dropping its contributions.\n", clients[i].pid);
+            clients[i].pid = 0;
+            pruned++;
+        }
+    }
+    return pruned;
+}
+
+/*
+ * Combine contributions of all clients into combined[] (constant, autocenter, gain),
+ * config overrides autocenter and gain if set
+ */
+static void mix(ffclient *clients, ffclient *config, int *combined)
+{
+    int i;
+    int constant = 0, autocenter = -1, gain = -1;
+    for (i = 0; i < FFMIXER_MAX_CLIENTS; i++) {
+        if (!clients[i].pid)
+            continue;
+        constant += clients[i].constant;
+        if (clients[i].autocenter > autocenter)
+            autocenter = clients[i].autocenter;
+        if (clients[i].gain >= 0 && (gain < 0 || clients[i].gain < gain))
+            gain = clients[i].gain;
+    }
+    if (constant > 32767)
+        constant = 32767;
+    if (constant < -32767)
+        constant = -32767;
+    combined[0] = constant;
+    if (config->autocenter >= 0)
+        autocenter = config->autocenter;
+    if (config->gain >= 0)
+        gain = config->gain;
+    combined[1] = autocenter < 0 ? 0 : autocenter;
+    combined[2] = gain < 0 ? 0xffff : gain;
+}
+
+/*
+ * Mix again and mark parameters whose combined value changed for sending
+ */
+static void remix(ffclient *clients, ffclient *config, ffparam *params, long long now, unsigned long long *dropped)
+{
+    int combined[NUM_PARAMS];
+    int i;
+
+    mix(clients, config, combined);
+    for (i = 0; i < NUM_PARAMS; i++) {
+        if (params[i].dirty && params[i].value != combined[i]) {
+            // pending value is overwritten before it was sent
+            (*dropped)++;
+        }
+        if (combined[i] != (params[i].dirty ? params[i].value : params[i].sent)) {
+            if (!params[i].dirty)
+                params[i].pending_since = now;
+            params[i].dirty = 1;
+            params[i].value = combined[i];
+        }
+        if (params[i].dirty && params[i].value == params[i].sent)
+            params[i].dirty = 0;
+    }
+}
+
+static int write_param(int fd, int param, int value, struct ff_effect *effect, int *playing)
+{
+    struct input_event ie;
+    memset(&ie, 0, sizeof(ie));
+    ie.type = EV_FF;
+
+    if (param == 0) {
+        effect->u.constant.level = value;
+        if (ioctl(fd, EVIOCSFF, effect) < 0) {
+            perror("Upload constant force");
+            return -1;
+        }
+        if (*playing)
+            return 0;
+        // start playing once, updating a playing effect keeps it running
+        ie.code = effect->id;
+        ie.value = 1;
+        *playing = 1;
+    } else {
+        ie.code = (param == 1) ? FF_AUTOCENTER : FF_GAIN;
+        ie.value = value;
+    }
+    if (write(fd, &ie, sizeof(ie)) == -1) {
+        perror("Write force feedback event");
+        return -1;
+    }
+    return 0;
+}
+
+int run_ffmixer(char *device_file_name, int duration_sec)
+{
+    static const char *param_names[NUM_PARAMS] = { "constant", "autocenter", "gain" };
+    ffclient clients[FFMIXER_MAX_CLIENTS];
+    ffclient config;
+    ffparam params[NUM_PARAMS];
+    struct sockaddr_un addr;
+    struct ff_effect effect;
+    int playing = 0;
+    int i;
+
+    int fd = open(device_file_name, O_RDWR);
+    if (fd == -1) {
+        perror("Open device file");
+        return -1;
+    }
+    if (socket_path(device_file_name, &addr) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (mkdir(RUN_DIR, 0755) != 0 && errno != EEXIST) {
+        perror("Create " RUN_DIR);
+        close(fd);
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sock == -1) {
+        perror("Create mixer socket");
+        close(fd);
+        return -1;
+    }
+    // only remove the socket if it is left over, not if another mixer is using it
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        printf("A force feedback mixer is already running for %s (%s).\n", device_file_name, addr.sun_path);
+        close(sock);
+        close(fd);
+        return -1;
+    }
+    unlink(addr.sun_path);
+    int passcred = 1;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || setsockopt(sock, SOL_SOCKET, SO_PASSCRED, &passcred, sizeof(passcred)) != 0) {
+        perror("Create mixer socket");
+        close(sock);
+        close(fd);
+        return -1;
+    }
+    struct group *gr = getgrnam(FFMIXER_GROUP);
+    if (!gr || chown(addr.sun_path, -1, gr->gr_gid) != 0)
+        printf("Could not hand mixer socket to group " FFMIXER_GROUP ", only root can use it.\n");
+    chmod(addr.sun_path, 0660);
+
+    memset(clients, 0, sizeof(clients));
+    memset(&config, 0, sizeof(config));
+    config.autocenter = -1;
+    config.gain = -1;
+    memset(params, 0, sizeof(params));
+    memset(&effect, 0, sizeof(effect));
+    effect.type = FF_CONSTANT;
+    effect.id = -1;
+    effect.direction = 0x4000;           /* along the wheel axis */
+    effect.replay.length = 0;            /* infinite */
+    params[2].sent = 0xffff;
+
+    long long slot_ns = endpoint_interval_ns(device_file_name);
+    printf("Force feedback mixer for %s listening on %s, output slot %lld us.\n", device_file_name, addr.sun_path,
+           slot_ns / 1000);
+
+    stop_mixer = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    long long start = now_ns();
+    long long deadline = duration_sec ? start + duration_sec * 1000000000LL : 0;
+    long long last_send = 0;
+    long long last_prune = start;
+    int writes = evdev_write_stats("ffmixer");
+    int next_param = 0;
+    unsigned long long received = 0, dropped = 0, sent = 0, failed = 0;
+    long long latencySum = 0, latencyMax = 0;
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+
+    while (!stop_mixer) {
+        long long now = now_ns();
+        if (deadline && now >= deadline)
+            break;
+
+        int anyDirty = params[0].dirty || params[1].dirty || params[2].dirty;
+        struct timespec timeout;
+        // wake up at least for the next check of dead clients
+        long long wait = last_prune + FFMIXER_PRUNE_SEC * 1000000000LL - now;
+        if (anyDirty && last_send + slot_ns - now < wait)
+            wait = last_send + slot_ns - now;
+        if (deadline && deadline - now < wait)
+            wait = deadline - now;
+        if (wait < 0)
+            wait = 0;
+        timeout.tv_sec = wait / 1000000000LL;
+        timeout.tv_nsec = wait % 1000000000LL;
+
+        int ret = ppoll(&pfd, 1, &timeout, NULL);
+        if (ret < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        now = now_ns();
+
+        int changed = 0;
+        if (now - last_prune >= FFMIXER_PRUNE_SEC * 1000000000LL) {
+            changed = prune_clients(clients);
+            last_prune = now;
+        }
+
+        if (ret > 0) {
+            ffmixmsg msg;
+            int pid;
+            while (recv_message(sock, &msg, &pid) == 0) {
+                received++;
+                if (msg.client == FFMIX_CONFIG_CLIENT) {
+                    // configuration is no vote, the latest change wins
+                    if (msg.type == FFMIX_AUTOCENTER)
+                        config.autocenter = msg.value;
+                    else if (msg.type == FFMIX_GAIN)
+                        config.gain = msg.value;
+                    remix(clients, &config, params, now, &dropped);
+                    continue;
+                }
+                ffclient *c = find_client(clients, pid, msg.type != FFMIX_RELEASE);
+                if (!c && msg.type != FFMIX_RELEASE && prune_clients(clients))
+                    c = find_client(clients, pid, 1);
+                if (!c) {
+                    if (msg.type != FFMIX_RELEASE) printf("Too many mixer clients, ignoring update of %d.\n", pid);
+                    continue;
+                }
+                switch (msg.type) {
+                    case FFMIX_CONSTANT:
+                        c->constant = msg.value;
+                        break;
+                    case FFMIX_AUTOCENTER:
+                        c->autocenter = msg.value;
+                        break;
+                    case FFMIX_GAIN:
+                        c->gain = msg.value;
+                        break;
+                    case FFMIX_RELEASE:
+                        c->pid = 0;
+                        break;
+                }
+                remix(clients, &config, params, now, &dropped);
+            }
+        }
+        if (changed)
+            remix(clients, &config, params, now, &dropped);
+
+        // one write per output slot, round robin over changed parameters
+        if (now - last_send >= slot_ns) {
+            for (i = 0; i < NUM_PARAMS; i++) {
+                int p = (next_param + i) % NUM_PARAMS;
+                if (!params[p].dirty)
+                    continue;
+                long long write_start = now_ns();
+                if (write_param(fd, p, params[p].value, &effect, &playing) == 0) {
+                    long long done = now_ns();
+                    stats_observe_ns(writes, done - write_start);
+                    long long latency = done - params[p].pending_since;
+                    latencySum += latency;
+                    if (latency > latencyMax)
+                        latencyMax = latency;
+                    params[p].sent = params[p].value;
+                    sent++;
+                    if (verbose_flag > 1) printf("Sent %s %d\n", param_names[p], params[p].value);
+                    params[p].dirty = 0;
+                } else {
+                    // keep it dirty, it is sent again once the other parameters had their turn
+                    failed++;
+                }
+                last_send = now;
+                next_param = (p + 1) % NUM_PARAMS;
+                break;
+            }
+        }
+    }
+
+    printf("Received %llu updates, sent %llu, dropped %llu (coalesced), %llu writes failed.\n", received, sent,
+           dropped, failed);
+    if (sent)
+        printf("Added latency: avg %lld us, max %lld us\n", latencySum / (long long)sent / 1000, latencyMax / 1000);
+
+    if (effect.id >= 0)
+        ioctl(fd, EVIOCRMFF, effect.id);
+    close(sock);
+    unlink(addr.sun_path);
+    close(fd);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
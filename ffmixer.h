@@ -0,0 +1,85 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ffmixer_h
+#define ffmixer_h
+
+#define RUN_DIR "/run/ltwheelconf"
+#define FFMIXER_GROUP "input"            /* members of this group may send updates to the mixer */
+#define FFMIXER_MAX_CLIENTS 32
+#define FFMIXER_DEFAULT_SLOT_US 2000     /* used if the endpoint interval can not be found in sysfs */
+#define FFMIXER_PRUNE_SEC 1              /* check this often for clients which exited without FFMIX_RELEASE */
+#define FFMIX_CONFIG_CLIENT 0            /* client id of configuration changes (--gain, --altautocenter) */
+
+/* message types */
+#define FFMIX_CONSTANT 1                 /* value: signed level -32767..32767 */
+#define FFMIX_AUTOCENTER 2               /* value: 0..0xffff as written to FF_AUTOCENTER */
+#define FFMIX_GAIN 3                     /* value: 0..0xffff as written to FF_GAIN */
+#define FFMIX_RELEASE 4                  /* client is done, drop its contributions */
+
+typedef struct {
+    int client;                          /* FFMIX_CONFIG_CLIENT for configuration changes, otherwise
+                                            ignored: clients are told apart by the pid in their
+                                            credentials, which the kernel fills in */
+    int type;
+    int value;
+} ffmixmsg;
+
+/*
+ * Force feedback mixer
+ *
+ * Several local clients (game bridges, rig software, ltwheelconf itself) send
+ * force feedback updates for the same wheel over a unix datagram socket in RUN_DIR.
+ * The mixer combines them into one effect set:
+ *  - constant forces of all clients are added (and clamped)
+ *  - the strongest autocenter request wins
+ *  - the lowest gain request wins
+ * Configuration changes (client FFMIX_CONFIG_CLIENT) are no vote: the latest one
+ * overrides autocenter or gain of all clients. Clients whose process is gone are
+ * dropped.
+ *
+ * Output is paced to the interval of the wheel's interrupt OUT endpoint. Every
+ * interval one changed parameter is written to the event device, if a
+ * parameter changes several times in between only the latest value is sent.
+ * Writes that fail are retried in a later interval.
+ * The number of dropped (overwritten) updates and the added latency are reported.
+ *
+ * Only root and members of FFMIXER_GROUP may send to the mixer. A second mixer
+ * for the same wheel refuses to start.
+ *
+ * duration_sec = 0 runs until interrupted.
+ */
+int run_ffmixer(char *device_file_name, int duration_sec);
+
+/*
+ * Send update to the mixer running for the wheel behind device_file_name, as
+ * client with the pid of the calling process.
+ * Returns 0 if the update was handed to a mixer, -1 if none is running.
+ */
+int ffmixer_send(char *device_file_name, int type, int value);
+
+/*
+ * Send configuration change (FFMIX_AUTOCENTER or FFMIX_GAIN) to the mixer running
+ * for the wheel behind device_file_name, replacing earlier configuration changes.
+ * Returns 0 if the change was handed to a mixer, -1 if none is running.
+ */
+int ffmixer_configure(char *device_file_name, int type, int value);
+
+#endif
@@ -0,0 +1,445 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "inventory.h"
+#include "uinputdev.h"
+#include "stats.h"
+#include "wheelfunctions.h"
+#include "ffproxy.h"
+
+/* Globals */
+extern int verbose_flag;
+
+typedef struct {
+    int used;
+    struct ff_effect effect;             /* as uploaded to the clone, id is the clone's id */
+    int real_id;                         /* id on the wheel, -1 if not uploaded (wheel gone) */
+    int playing;                         /* repetitions of the last play request, 0 if stopped */
+    long long end_ns;                    /* 0 plays until stopped */
+} shadoweffect;
+
+typedef struct {
+    int ufd;                             /* clone (uinput) */
+    int fd;                              /* wheel, -1 while gone */
+    char key[256];
+    char clone_node[128];
+    shadoweffect effects[FFPROXY_MAX_EFFECTS];
+    int gain;                            /* -1 if not set by the game */
+    int autocenter;                      /* -1 if not set by the game */
+    int writes;                          /* metric id of event device write times */
+    unsigned long long uploads, erases, plays, forwarded;
+} ffproxy;
+
+static volatile sig_atomic_t stop_proxy = 0;
+
+static void handle_stop(int sig)
+{
+    stop_proxy = 1;
+}
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int write_ff(ffproxy *p, int code, int value)
+{
+    struct input_event ie;
+    memset(&ie, 0, sizeof(ie));
+    ie.type = EV_FF;
+    ie.code = code;
+    ie.value = value;
+    long long start = now_ns();
+    if (write(p->fd, &ie, sizeof(ie)) == -1)
+        return -1;
+    stats_observe_ns(p->writes, now_ns() - start);
+    return 0;
+}
+
+/*
+ * Upload shadowed effect to the wheel, keeping the wheel's id if it is already there
+ * Returns 0 or -errno.
+ */
+static int upload_effect(ffproxy *p, shadoweffect *s)
+{
+    struct ff_effect effect = s->effect;
+    effect.id = s->real_id;
+    if (ioctl(p->fd, EVIOCSFF, &effect) < 0)
+        return -errno;
+    s->real_id = effect.id;
+    return 0;
+}
+
+static void handle_upload(ffproxy *p, int request_id)
+{
+    struct uinput_ff_upload up;
+    memset(&up, 0, sizeof(up));
+    up.request_id = request_id;
+    if (ioctl(p->ufd, UI_BEGIN_FF_UPLOAD, &up) < 0) {
+        perror("Begin effect upload");
+        return;
+    }
+    if (up.effect.id < 0 || up.effect.id >= FFPROXY_MAX_EFFECTS) {
+        up.retval = -EINVAL;
+    } else {
+        shadoweffect s = p->effects[up.effect.id];
+        if (!s.used)
+            s.real_id = -1;
+        s.used = 1;
+        s.effect = up.effect;
+        // while the wheel is gone the effect is only shadowed, it is uploaded once the wheel is back
+        up.retval = (p->fd != -1) ? upload_effect(p, &s) : 0;
+        if (up.retval == 0) {
+            p->effects[up.effect.id] = s;
+            p->uploads++;
+        }
+        if (verbose_flag > 1) printf("Effect %d uploaded as %d: %d\n", up.effect.id, s.real_id, up.retval);
+    }
+    if (ioctl(p->ufd, UI_END_FF_UPLOAD, &up) < 0)
+        perror("End effect upload");
+}
+
+static void handle_erase(ffproxy *p, int request_id)
+{
+    struct uinput_ff_erase er;
+    memset(&er, 0, sizeof(er));
+    er.request_id = request_id;
+    if (ioctl(p->ufd, UI_BEGIN_FF_ERASE, &er) < 0) {
+        perror("Begin effect erase");
+        return;
+    }
+    er.retval = 0;
+    if (er.effect_id < FFPROXY_MAX_EFFECTS) {
+        shadoweffect *s = &p->effects[er.effect_id];
+        if (p->fd != -1 && s->real_id >= 0 && ioctl(p->fd, EVIOCRMFF, s->real_id) < 0)
+            er.retval = -errno;
+        memset(s, 0, sizeof(*s));
+        p->erases++;
+    }
+    if (ioctl(p->ufd, UI_END_FF_ERASE, &er) < 0)
+        perror("End effect erase");
+}
+
+static void handle_ff(ffproxy *p, int code, int value)
+{
+    if (code == FF_GAIN || code == FF_AUTOCENTER) {
+        if (code == FF_GAIN)
+            p->gain = value;
+        else
+            p->autocenter = value;
+        if (p->fd != -1)
+            write_ff(p, code, value);
+        return;
+    }
+    if (code >= FFPROXY_MAX_EFFECTS || !p->effects[code].used)
+        return;
+
+    // remember play state, so the effect can be restarted after a rebind
+    shadoweffect *s = &p->effects[code];
+    s->playing = value;
+    s->end_ns = 0;
+    if (value > 0 && s->effect.replay.length)
+        s->end_ns = now_ns() + (long long)value * (s->effect.replay.delay + s->effect.replay.length) * 1000000LL;
+    p->plays++;
+    if (p->fd != -1 && s->real_id >= 0)
+        write_ff(p, s->real_id, value);
+}
+
+/*
+ * Read what the game wrote to the clone: effect uploads, erases, play requests, gain and autocenter
+ */
+static void read_clone(ffproxy *p)
+{
+    struct input_event ev[64];
+    ssize_t len;
+    int i;
+
+    while ((len = read(p->ufd, ev, sizeof(ev))) > 0) {
+        int numEvents = len / sizeof(struct input_event);
+        for (i = 0; i < numEvents; i++) {
+            if (ev[i].type == EV_UINPUT && ev[i].code == UI_FF_UPLOAD)
+                handle_upload(p, ev[i].value);
+            else if (ev[i].type == EV_UINPUT && ev[i].code == UI_FF_ERASE)
+                handle_erase(p, ev[i].value);
+            else if (ev[i].type == EV_FF)
+                handle_ff(p, ev[i].code, ev[i].value);
+        }
+    }
+}
+
+/*
+ * Forward input of the wheel to the clone.
+ * Returns -1 if the event device is gone.
+ */
+static int forward_input(ffproxy *p)
+{
+    struct input_event ev[64];
+    ssize_t len;
+
+    while ((len = read(p->fd, ev, sizeof(ev))) > 0) {
+        if (write(p->ufd, ev, len) != len && verbose_flag)
+            perror("Forward input");
+        p->forwarded += len / sizeof(struct input_event);
+    }
+    if (len < 0 && errno != EAGAIN)
+        return -1;
+    return 0;
+}
+
+/*
+ * Look for the event device of the wheel, skipping the clone.
+ * Returns open file descriptor or -1 if it is not (yet) there.
+ */
+static int find_wheel_node(ffproxy *p, char *path, size_t len)
+{
+    DIR *d = opendir("/dev/input");
+    struct dirent *entry;
+    char key[256];
+    int fd = -1;
+
+    if (!d)
+        return -1;
+    while (fd == -1 && (entry = readdir(d))) {
+        if (strncmp(entry->d_name, "event", 5) != 0)
+            continue;
+        snprintf(path, len, "/dev/input/%.48s", entry->d_name);
+        if (strcmp(path, p->clone_node) == 0)
+            continue;
+        // node may not be accessible yet, udev is still setting permissions
+        fd = open(path, O_RDWR | O_NONBLOCK);
+        if (fd == -1)
+            continue;
+        if (get_evdev_key(fd, key, sizeof(key)) != 0 || strcmp(key, p->key) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    closedir(d);
+    return fd;
+}
+
+static void grab_wheel(int fd, const char *path)
+{
+    // the game should only see the clone
+    if (ioctl(fd, EVIOCGRAB, 1) < 0)
+        printf("Could not grab %s, the game will see the wheel twice.\n", path);
+}
+
+/*
+ * Bring the new event device to the state the game set up: upload all effects,
+ * set gain and autocenter, restart effects that were playing.
+ * Returns number of effects restored.
+ */
+static int restore_effects(ffproxy *p)
+{
+    long long now = now_ns();
+    int restored = 0;
+    int i;
+
+    for (i = 0; i < FFPROXY_MAX_EFFECTS; i++) {
+        shadoweffect *s = &p->effects[i];
+        if (!s->used)
+            continue;
+        s->real_id = -1;
+        int ret = upload_effect(p, s);
+        if (ret != 0) {
+            printf("Could not restore effect %d: %s\n", i, strerror(-ret));
+            continue;
+        }
+        restored++;
+    }
+    if (p->gain >= 0)
+        write_ff(p, FF_GAIN, p->gain);
+    if (p->autocenter >= 0)
+        write_ff(p, FF_AUTOCENTER, p->autocenter);
+    // effects with a length are restarted from the beginning, not where they were cut off
+    for (i = 0; i < FFPROXY_MAX_EFFECTS; i++) {
+        shadoweffect *s = &p->effects[i];
+        if (!s->used || s->real_id < 0 || s->playing <= 0)
+            continue;
+        if (s->end_ns && s->end_ns <= now) {
+            s->playing = 0;
+            continue;
+        }
+        write_ff(p, s->real_id, s->playing);
+    }
+    return restored;
+}
+
+int run_ffproxy(char *device_file_name, int duration_sec)
+{
+    static ffproxy proxy;
+    ffproxy *p = &proxy;
+    devcaps caps;
+    char path[128];
+    int i;
+
+    memset(p, 0, sizeof(*p));
+    p->gain = p->autocenter = -1;
+    p->writes = evdev_write_stats("ffproxy");
+    p->fd = open(device_file_name, O_RDWR | O_NONBLOCK);
+    if (p->fd == -1) {
+        perror("Open device file");
+        return -1;
+    }
+    if (get_evdev_key(p->fd, p->key, sizeof(p->key)) != 0 || read_devcaps(p->fd, &caps) != 0) {
+        close(p->fd);
+        return -1;
+    }
+    if (!caps_test_bit(EV_FF, caps.evbits)) {
+        printf("Device %s has no force feedback.\n", device_file_name);
+        close(p->fd);
+        return -1;
+    }
+    if (caps.ff_effects_max > FFPROXY_MAX_EFFECTS)
+        caps.ff_effects_max = FFPROXY_MAX_EFFECTS;
+
+    p->ufd = create_uinput(&caps);
+    if (p->ufd == -1) {
+        close(p->fd);
+        return -1;
+    }
+    uinput_event_node(p->ufd, p->clone_node, sizeof(p->clone_node));
+
+    // new event devices of the wheel show up here after a rebind
+    int ifd = inotify_init1(IN_NONBLOCK);
+    if (ifd == -1 || inotify_add_watch(ifd, "/dev/input", IN_CREATE | IN_ATTRIB) < 0) {
+        if (verbose_flag) perror("Watch /dev/input");
+    }
+    grab_wheel(p->fd, device_file_name);
+    printf("Force feedback proxy for %s running, let the game use %s.\n", device_file_name,
+           p->clone_node[0] ? p->clone_node : "the new event device");
+
+    int dropouts = stats_histogram("ltwheelconf_ff_dropout_seconds", 0,
+                                   "Force feedback dropout while the event device of a wheel was recreated");
+
+    stop_proxy = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    long long start = now_ns();
+    long long deadline = duration_sec ? start + duration_sec * 1000000000LL : 0;
+    long long lost = 0;
+    unsigned long long rebinds = 0, restoredTotal = 0;
+    long long dropoutSum = 0, dropoutMax = 0, waitSum = 0;
+    struct pollfd pfd[3];
+
+    while (!stop_proxy) {
+        long long now = now_ns();
+        if (deadline && now >= deadline)
+            break;
+        int timeout = -1;
+        if (deadline)
+            timeout = (deadline - now) / 1000000LL + 1;
+        if (p->fd == -1 && (timeout < 0 || timeout > FFPROXY_RESCAN_MS))
+            timeout = FFPROXY_RESCAN_MS;
+
+        pfd[0].fd = p->ufd;
+        pfd[1].fd = p->fd;                   // ignored by poll while the wheel is gone
+        pfd[2].fd = (p->fd == -1) ? ifd : -1;
+        for (i = 0; i < 3; i++) {
+            pfd[i].events = POLLIN;
+            pfd[i].revents = 0;
+        }
+        if (poll(pfd, 3, timeout) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        if (pfd[0].revents & POLLIN)
+            read_clone(p);
+
+        if (p->fd != -1 && pfd[1].revents) {
+            if ((pfd[1].revents & (POLLERR | POLLHUP | POLLNVAL)) || forward_input(p) != 0) {
+                // driver was detached, effects on the wheel are gone
+                close(p->fd);
+                p->fd = -1;
+                lost = now_ns();
+                for (i = 0; i < FFPROXY_MAX_EFFECTS; i++)
+                    p->effects[i].real_id = -1;
+                if (verbose_flag) printf("Event device of the wheel is gone, waiting for it to come back.\n");
+            }
+        }
+
+        if (p->fd == -1) {
+            char buf[4096];
+            if (ifd != -1)
+                while (read(ifd, buf, sizeof(buf)) > 0)
+                    ;
+            p->fd = find_wheel_node(p, path, sizeof(path));
+            if (p->fd != -1) {
+                long long found = now_ns();
+                grab_wheel(p->fd, path);
+                int restored = restore_effects(p);
+                long long done = now_ns();
+                rebinds++;
+                restoredTotal += restored;
+                dropoutSum += done - lost;
+                waitSum += found - lost;
+                if (done - lost > dropoutMax)
+                    dropoutMax = done - lost;
+                stats_observe_ns(dropouts, done - lost);
+                printf("Wheel is back on %s: %d effects restored, dropout %lld ms (%lld us to restore).\n", path,
+                       restored, (done - lost) / 1000000, (done - found) / 1000);
+            }
+        }
+    }
+
+    printf("Forwarded %llu input events, %llu effect uploads, %llu erases, %llu play requests.\n", p->forwarded,
+           p->uploads, p->erases, p->plays);
+    if (rebinds)
+        printf("%llu rebinds, %llu effects restored, dropout avg %lld ms (waiting for device %lld ms), max %lld ms\n",
+               rebinds, restoredTotal, dropoutSum / (long long)rebinds / 1000000, waitSum / (long long)rebinds / 1000000,
+               dropoutMax / 1000000);
+    if (p->fd == -1)
+        printf("Wheel did not come back.\n");
+
+    if (p->fd != -1) {
+        for (i = 0; i < FFPROXY_MAX_EFFECTS; i++) {
+            if (p->effects[i].used && p->effects[i].real_id >= 0)
+                ioctl(p->fd, EVIOCRMFF, p->effects[i].real_id);
+        }
+        ioctl(p->fd, EVIOCGRAB, 0);
+        close(p->fd);
+    }
+    if (ifd != -1)
+        close(ifd);
+    destroy_uinput(p->ufd);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
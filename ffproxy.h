@@ -0,0 +1,50 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ffproxy_h
+#define ffproxy_h
+
+#define FFPROXY_MAX_EFFECTS 16           /* ff-memless, used by hid-lg4ff, has 16 */
+#define FFPROXY_RESCAN_MS 5              /* rescan event devices this often while the wheel is gone */
+
+/*
+ * Force feedback proxy
+ *
+ * Every USB command detaches and re-attaches the kernel driver, so the event device
+ * of the wheel is destroyed and recreated (e.g. when the range is changed while a
+ * game is running) and all force feedback effects uploaded to it are lost.
+ *
+ * The proxy grabs the event device and creates a virtual clone (uinput) for the
+ * game. Input is forwarded to the clone, effects uploaded to the clone are kept
+ * in a shadow table and uploaded to the wheel, with effect ids mapped between the
+ * clone and the wheel. When the event device disappears, the proxy waits for the
+ * new one (same wheel key, see get_evdev_key()), grabs it and re-uploads every
+ * effect, restores gain and autocenter and restarts effects that were playing.
+ * The game keeps using the clone and never notices the rebind. Uploads while the
+ * wheel is gone are only shadowed and applied once it is back.
+ *
+ * The dropout (event device gone until all effects are running again) is printed
+ * for every rebind and summed up at the end.
+ *
+ * duration_sec = 0 runs until interrupted.
+ */
+int run_ffproxy(char *device_file_name, int duration_sec);
+
+#endif
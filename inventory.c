@@ -0,0 +1,527 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+#include <linux/input.h>
+
+#include "wheels.h"
+#include "inventory.h"
+
+/* Globals */
+extern int verbose_flag;
+
+
+static int read_sysfs_attr(const char *dir, const char *attr, char *buf, size_t len)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (!fgets(buf, len, f)) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    buf[strcspn(buf, "\n")] = 0;
+    return 0;
+}
+
+static int read_sysfs_hex(const char *dir, const char *attr, unsigned int *value)
+{
+    char buf[32];
+    if (read_sysfs_attr(dir, attr, buf, sizeof(buf)) != 0)
+        return -1;
+    *value = strtoul(buf, 0, 16);
+    return 0;
+}
+
+/*
+ * Find wheelstruct matching a pid.
+ * All wheels share pid 0xc294 in restricted mode, so in this case bcdDevice is
+ * used to tell them apart. Returns 0 if this is not possible.
+ */
+static const wheelstruct *match_wheel(unsigned int pid, unsigned int bcdDevice, int *native)
+{
+    int numWheels = sizeof(wheels)/sizeof(wheelstruct);
+    int i;
+
+    for (i = 0; i < numWheels; i++) {
+        if (wheels[i].native_pid == pid && wheels[i].native_pid != wheels[i].restricted_pid) {
+            *native = 1;
+            return &wheels[i];
+        }
+    }
+    for (i = 0; i < numWheels; i++) {
+        if (wheels[i].restricted_pid == pid && wheels[i].revision && wheels[i].revision == bcdDevice) {
+            *native = (wheels[i].native_pid == wheels[i].restricted_pid);
+            return &wheels[i];
+        }
+    }
+    *native = 0;
+    for (i = 0; i < numWheels; i++) {
+        if (wheels[i].restricted_pid == pid) {
+            // known pid, but not unique
+            int j;
+            for (j = i + 1; j < numWheels; j++) {
+                if (wheels[j].restricted_pid == pid)
+                    return 0;
+            }
+            *native = (wheels[i].native_pid == wheels[i].restricted_pid);
+            return &wheels[i];
+        }
+    }
+    return 0;
+}
+
+static int is_known_pid(unsigned int pid)
+{
+    int numWheels = sizeof(wheels)/sizeof(wheelstruct);
+    int i;
+    for (i = 0; i < numWheels; i++) {
+        if (wheels[i].native_pid == pid || wheels[i].restricted_pid == pid)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Look up hid device below interface 0 of the usb device and find its
+ * event and hidraw nodes as well as the range attribute of hid-lg4ff.
+ */
+static void find_hid_nodes(const char *usbdir, wheelinfo *info)
+{
+    char ifdir[512];
+    char hiddir[768];
+    char subdir[1024];
+    struct dirent *entry;
+    DIR *d;
+
+    snprintf(ifdir, sizeof(ifdir), "%s:1.0", usbdir);
+    d = opendir(ifdir);
+    if (!d)
+        return;
+    hiddir[0] = 0;
+    while ((entry = readdir(d)) != NULL) {
+        if (strncmp(entry->d_name, "0003:", 5) == 0) {
+            snprintf(hiddir, sizeof(hiddir), "%s/%s", ifdir, entry->d_name);
+            break;
+        }
+    }
+    closedir(d);
+    if (!hiddir[0])
+        return;
+
+    char buf[32];
+    if (read_sysfs_attr(hiddir, "range", buf, sizeof(buf)) == 0)
+        info->range = atoi(buf);
+
+    snprintf(subdir, sizeof(subdir), "%s/hidraw", hiddir);
+    d = opendir(subdir);
+    if (d) {
+        while ((entry = readdir(d)) != NULL) {
+            if (strncmp(entry->d_name, "hidraw", 6) == 0) {
+                snprintf(info->hidraw, sizeof(info->hidraw), "/dev/%.48s", entry->d_name);
+                break;
+            }
+        }
+        closedir(d);
+    }
+
+    snprintf(subdir, sizeof(subdir), "%s/input", hiddir);
+    d = opendir(subdir);
+    if (d) {
+        while ((entry = readdir(d)) != NULL && !info->evdev[0]) {
+            if (strncmp(entry->d_name, "input", 5) != 0)
+                continue;
+            char inputdir[1280];
+            snprintf(inputdir, sizeof(inputdir), "%s/%s", subdir, entry->d_name);
+            DIR *d2 = opendir(inputdir);
+            if (!d2)
+                continue;
+            struct dirent *e2;
+            while ((e2 = readdir(d2)) != NULL) {
+                if (strncmp(e2->d_name, "event", 5) == 0) {
+                    snprintf(info->evdev, sizeof(info->evdev), "/dev/input/%.48s", e2->d_name);
+                    break;
+                }
+            }
+            closedir(d2);
+        }
+        closedir(d);
+    }
+}
+
+static int read_sysfs_wheel(const char *name, wheelinfo *info)
+{
+    char usbdir[512];
+    char buf[32];
+
+    snprintf(usbdir, sizeof(usbdir), SYSFS_USB_DEVICES "/%s", name);
+    if (read_sysfs_hex(usbdir, "idVendor", &info->vid) != 0 || info->vid != VID_LOGITECH)
+        return -1;
+    if (read_sysfs_hex(usbdir, "idProduct", &info->pid) != 0 || !is_known_pid(info->pid))
+        return -1;
+
+    read_sysfs_hex(usbdir, "bcdDevice", &info->bcdDevice);
+    if (read_sysfs_attr(usbdir, "busnum", buf, sizeof(buf)) == 0)
+        info->busnum = atoi(buf);
+    if (read_sysfs_attr(usbdir, "devnum", buf, sizeof(buf)) == 0)
+        info->devnum = atoi(buf);
+    read_sysfs_attr(usbdir, "product", info->product, sizeof(info->product));
+    read_sysfs_attr(usbdir, "serial", info->serial, sizeof(info->serial));
+    strncpy(info->port_path, name, sizeof(info->port_path) - 1);
+    info->wheel = match_wheel(info->pid, info->bcdDevice, &info->native);
+    find_hid_nodes(usbdir, info);
+    return 0;
+}
+
+static void init_wheelinfo(wheelinfo *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->range = -1;
+}
+
+
+/*
+ * String descriptor cache
+ *
+ * One line per device: "<port path> <vid>:<pid>:<bcdDevice> <busnum>.<devnum>\t<product>\t<serial>"
+ * The device address is part of the key, so a replugged (and thus re-enumerated)
+ * device is looked up again.
+ */
+static void make_cache_key(char *key, size_t len, const char *port_path, struct libusb_device_descriptor *desc,
+                           int busnum, int devnum)
+{
+    snprintf(key, len, "%s %04x:%04x:%04x %d.%d", port_path, desc->idVendor, desc->idProduct, desc->bcdDevice,
+             busnum, devnum);
+}
+
+static int cache_lookup(const char *key, char *product, size_t plen, char *serial, size_t slen)
+{
+    char line[512];
+    size_t keylen = strlen(key);
+    FILE *f = fopen(STRING_CACHE_FILE, "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, key, keylen) != 0 || line[keylen] != '\t')
+            continue;
+        line[strcspn(line, "\n")] = 0;
+        char *p = line + keylen + 1;
+        char *s = strchr(p, '\t');
+        if (s)
+            *s++ = 0;
+        if (product)
+            snprintf(product, plen, "%s", p);
+        if (serial)
+            snprintf(serial, slen, "%s", s ? s : "");
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+    return -1;
+}
+
+/*
+ * Store entry, replacing earlier entries of the same port (their bus/device number
+ * is outdated once the device re-enumerated). The cache is rewritten to a temporary
+ * file and renamed, so it does not grow and readers never see it half written.
+ * Every writer uses its own temporary file: concurrent writers can drop each other's
+ * new entry (it is fetched again next time), but never mix up the file.
+ */
+static void cache_store(const char *key, const char *product, const char *serial)
+{
+    char line[512];
+    char tmpname[] = STRING_CACHE_FILE ".XXXXXX";
+    size_t portlen = strcspn(key, " ");
+
+    if (mkdir(CACHE_DIR, 0755) != 0 && errno != EEXIST) {
+        if (verbose_flag) perror("Create cache directory");
+        return;
+    }
+    int fd = mkstemp(tmpname);
+    if (fd == -1) {
+        if (verbose_flag) perror("Open string cache");
+        return;
+    }
+    fchmod(fd, 0644);
+    FILE *tmp = fdopen(fd, "w");
+    if (!tmp) {
+        if (verbose_flag) perror("Open string cache");
+        close(fd);
+        unlink(tmpname);
+        return;
+    }
+    FILE *f = fopen(STRING_CACHE_FILE, "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, key, portlen) == 0 && line[portlen] == ' ')
+                continue;
+            fputs(line, tmp);
+        }
+        fclose(f);
+    }
+    fprintf(tmp, "%s\t%s\t%s\n", key, product, serial);
+    if (fclose(tmp) != 0 || rename(tmpname, STRING_CACHE_FILE) != 0) {
+        if (verbose_flag) perror("Write string cache");
+        unlink(tmpname);
+    }
+}
+
+/*
+ * Fetch product and serial strings of device, using the cache if possible.
+ * handle may be 0, in this case the device is opened on a cache miss.
+ */
+static int get_cached_strings(libusb_device *dev, libusb_device_handle *handle, struct libusb_device_descriptor *desc,
+                              char *product, size_t plen, char *serial, size_t slen)
+{
+    char port_path[64];
+    char key[256];
+
+    get_port_path(dev, port_path, sizeof(port_path));
+    make_cache_key(key, sizeof(key), port_path, desc, libusb_get_bus_number(dev), libusb_get_device_address(dev));
+    if (cache_lookup(key, product, plen, serial, slen) == 0)
+        return 0;
+
+    if (verbose_flag) printf("String cache miss for %s, querying device.\n", key);
+
+    int opened = 0;
+    if (!handle) {
+        if (libusb_open(dev, &handle) != 0)
+            return -1;
+        opened = 1;
+    }
+    unsigned char p[128];
+    unsigned char s[128];
+    memset(p, 0, sizeof(p));
+    memset(s, 0, sizeof(s));
+    if (desc->iProduct)
+        libusb_get_string_descriptor_ascii(handle, desc->iProduct, p, sizeof(p));
+    if (desc->iSerialNumber)
+        libusb_get_string_descriptor_ascii(handle, desc->iSerialNumber, s, sizeof(s));
+    if (opened)
+        libusb_close(handle);
+
+    snprintf(product, plen, "%s", p);
+    snprintf(serial, slen, "%s", s);
+    cache_store(key, product, serial);
+    return 0;
+}
+
+
+int get_port_path(libusb_device *dev, char *path, size_t len)
+{
+    uint8_t ports[8];
+    int numPorts = libusb_get_port_numbers(dev, ports, sizeof(ports));
+    int pos = snprintf(path, len, "%d", libusb_get_bus_number(dev));
+    int i;
+    if (numPorts <= 0) {
+        // root hub or unknown topology
+        snprintf(path + pos, len - pos, "-0");
+        return -1;
+    }
+    for (i = 0; i < numPorts && pos < len; i++) {
+        pos += snprintf(path + pos, len - pos, "%c%d", i == 0 ? '-' : '.', ports[i]);
+    }
+    return 0;
+}
+
+int get_product_string(libusb_device *dev, libusb_device_handle *handle, struct libusb_device_descriptor *desc,
+                       unsigned char *product, int len)
+{
+    char port_path[64];
+    char usbdir[512];
+    char serial[128];
+
+    get_port_path(dev, port_path, sizeof(port_path));
+    snprintf(usbdir, sizeof(usbdir), SYSFS_USB_DEVICES "/%s", port_path);
+    if (read_sysfs_attr(usbdir, "product", (char *)product, len) == 0)
+        return 0;
+    return get_cached_strings(dev, handle, desc, (char *)product, len, serial, sizeof(serial));
+}
+
+/*
+ * Fallback if sysfs is not available: enumerate via libusb.
+ */
+static int find_wheels_libusb(wheelinfo *list, int max)
+{
+    libusb_device **devs;
+    ssize_t cnt = libusb_get_device_list(NULL, &devs);
+    int numFound = 0;
+    int i;
+
+    if (cnt < 0) {
+        printf("Unable to get USB device list: %s\n", libusb_error_name(cnt));
+        return 0;
+    }
+    for (i = 0; i < cnt && numFound < max; i++) {
+        struct libusb_device_descriptor desc;
+        if (libusb_get_device_descriptor(devs[i], &desc) != 0)
+            continue;
+        if (desc.idVendor != VID_LOGITECH || !is_known_pid(desc.idProduct))
+            continue;
+
+        wheelinfo *info = &list[numFound++];
+        init_wheelinfo(info);
+        get_port_path(devs[i], info->port_path, sizeof(info->port_path));
+        info->busnum = libusb_get_bus_number(devs[i]);
+        info->devnum = libusb_get_device_address(devs[i]);
+        info->vid = desc.idVendor;
+        info->pid = desc.idProduct;
+        info->bcdDevice = desc.bcdDevice;
+        info->wheel = match_wheel(info->pid, info->bcdDevice, &info->native);
+        get_cached_strings(devs[i], 0, &desc, info->product, sizeof(info->product), info->serial, sizeof(info->serial));
+    }
+    libusb_free_device_list(devs, 1);
+    return numFound;
+}
+
+int find_wheels(wheelinfo *list, int max)
+{
+    DIR *d = opendir(SYSFS_USB_DEVICES);
+    struct dirent *entry;
+    int numFound = 0;
+
+    if (!d) {
+        if (verbose_flag) perror("Open " SYSFS_USB_DEVICES);
+        return find_wheels_libusb(list, max);
+    }
+    while ((entry = readdir(d)) != NULL && numFound < max) {
+        // skip interfaces ("3-1.2:1.0") and root hubs ("usb3")
+        if (entry->d_name[0] == '.' || strchr(entry->d_name, ':') || strncmp(entry->d_name, "usb", 3) == 0)
+            continue;
+        init_wheelinfo(&list[numFound]);
+        if (read_sysfs_wheel(entry->d_name, &list[numFound]) == 0)
+            numFound++;
+    }
+    closedir(d);
+    return numFound;
+}
+
+int find_wheel_by_port_path(const char *port_path, wheelinfo *info)
+{
+    init_wheelinfo(info);
+    if (read_sysfs_wheel(port_path, info) == 0)
+        return 0;
+
+    wheelinfo list[MAX_INVENTORY];
+    int numFound = find_wheels_libusb(list, MAX_INVENTORY);
+    int i;
+    for (i = 0; i < numFound; i++) {
+        if (strcmp(list[i].port_path, port_path) == 0) {
+            *info = list[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int get_evdev_key(int fd, char *key, size_t len)
+{
+    char uniq[128];
+    char phys[128];
+    struct input_id id;
+    char *c;
+
+    memset(uniq, 0, sizeof(uniq));
+    memset(phys, 0, sizeof(phys));
+    if (ioctl(fd, EVIOCGID, &id) != 0) {
+        perror("Get device id");
+        return -1;
+    }
+    ioctl(fd, EVIOCGUNIQ(sizeof(uniq) - 1), uniq);
+    ioctl(fd, EVIOCGPHYS(sizeof(phys) - 1), phys);
+
+    if (uniq[0])
+        snprintf(key, len, "%04x_%04x_%s", id.vendor, id.product, uniq);
+    else
+        snprintf(key, len, "%04x_%04x_%s", id.vendor, id.product, phys);
+
+    // key is used as file name
+    for (c = key; *c; c++) {
+        if (*c == '/' || *c == ' ' || *c == ':')
+            *c = '-';
+    }
+    return 0;
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", (unsigned char)*s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+void list_devices_json()
+{
+    wheelinfo list[MAX_INVENTORY];
+    int numFound = find_wheels(list, MAX_INVENTORY);
+    int i;
+
+    printf("[");
+    for (i = 0; i < numFound; i++) {
+        wheelinfo *info = &list[i];
+        printf("%s\n  {\"bus\": %d, \"device\": %d, \"port_path\": ", i ? "," : "", info->busnum, info->devnum);
+        print_json_string(info->port_path);
+        printf(", \"vid\": \"%04x\", \"pid\": \"%04x\", \"wheel\": ", info->vid, info->pid);
+        if (info->wheel)
+            print_json_string(info->wheel->shortname);
+        else
+            printf("null");
+        printf(", \"mode\": \"%s\", \"bcdDevice\": \"%04x\", \"product\": ",
+               info->native ? "native" : "restricted", info->bcdDevice);
+        print_json_string(info->product);
+        printf(", \"serial\": ");
+        print_json_string(info->serial);
+        printf(", \"evdev\": ");
+        if (info->evdev[0])
+            print_json_string(info->evdev);
+        else
+            printf("null");
+        printf(", \"hidraw\": ");
+        if (info->hidraw[0])
+            print_json_string(info->hidraw);
+        else
+            printf("null");
+        printf(", \"settings\": {\"range\": ");
+        if (info->range >= 0)
+            printf("%d", info->range);
+        else
+            printf("null");
+        printf("}}");
+    }
+    printf("%s]\n", numFound ? "\n" : "");
+}
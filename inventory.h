@@ -0,0 +1,90 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef inventory_h
+#define inventory_h
+
+#include <stddef.h>
+#include <libusb-1.0/libusb.h>
+
+#include "wheels.h"
+
+#define SYSFS_USB_DEVICES "/sys/bus/usb/devices"
+#define CACHE_DIR "/var/cache/ltwheelconf"
+#define STRING_CACHE_FILE CACHE_DIR "/strings"
+#define MAX_INVENTORY 32
+
+typedef struct {
+    char port_path[64];                  /* e.g. "3-1.2", same as sysfs device name */
+    int busnum;
+    int devnum;
+    unsigned int vid;
+    unsigned int pid;
+    unsigned int bcdDevice;
+    char product[128];
+    char serial[128];
+    char evdev[64];                      /* empty if no event node is bound */
+    char hidraw[64];                     /* empty if no hidraw node is bound */
+    const wheelstruct *wheel;            /* 0 if pid is ambiguous (restricted mode) */
+    int native;
+    int range;                           /* as exposed by hid-lg4ff, -1 if unknown */
+} wheelinfo;
+
+/*
+ * Collect all connected Logitech wheels.
+ * Everything is read from sysfs, so no USB traffic is caused. If sysfs is not
+ * available, libusb enumeration is used and string descriptors are served from
+ * the cache in STRING_CACHE_FILE, only asking the device on a cache miss.
+ * Returns number of wheels stored in list.
+ */
+int find_wheels(wheelinfo *list, int max);
+
+/*
+ * Print inventory of all connected wheels as JSON array
+ */
+void list_devices_json();
+
+/*
+ * Build bus/port path of device (e.g. "3-1.2"), as used by sysfs.
+ */
+int get_port_path(libusb_device *dev, char *path, size_t len);
+
+/*
+ * Get iProduct string of device.
+ * Tries sysfs first, then the string cache and only then queries the device.
+ */
+int get_product_string(libusb_device *dev, libusb_device_handle *handle, struct libusb_device_descriptor *desc,
+                       unsigned char *product, int len);
+
+/*
+ * Find wheel connected with bus/port path and fill info.
+ * Returns 0 on success, -1 if not found.
+ */
+int find_wheel_by_port_path(const char *port_path, wheelinfo *info);
+
+/*
+ * Build a key identifying the wheel behind an open event device, used to store
+ * per wheel data like calibration. This is the serial number if the wheel has
+ * one, otherwise vendor, product and physical path (which is stable as long as
+ * the wheel stays connected to the same port).
+ */
+int get_evdev_key(int fd, char *key, size_t len);
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "wheels.h"
+#include "wheelfunctions.h"
+#include "shmslot.h"
+#include "leds.h"
+
+/* Globals */
+extern int verbose_flag;
+
+/* default thresholds in percent of the redline */
+static const int default_percent[NUM_LEDS] = { 75, 80, 85, 90, 95 };
+
+static volatile sig_atomic_t stop_leds = 0;
+
+static void handle_stop(int sig)
+{
+    stop_leds = 1;
+}
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long cpu_ns()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (long long)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000LL
+           + (long long)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000LL;
+}
+
+int leds_for_rpm(int rpm, const int *thresholds)
+{
+    int leds = 0;
+    int i;
+    for (i = 0; i < NUM_LEDS; i++) {
+        if (rpm >= thresholds[i])
+            leds |= 1 << i;
+    }
+    return leds;
+}
+
+int parse_thresholds(char *list, int *thresholds)
+{
+    int num = 0;
+    char *t = strtok(list, ",");
+    while (t) {
+        if (num == NUM_LEDS)
+            return -1;
+        thresholds[num] = atoi(t);
+        if (num && thresholds[num] < thresholds[num - 1])
+            return -1;
+        num++;
+        t = strtok(NULL, ",");
+    }
+    return num == NUM_LEDS ? 0 : -1;
+}
+
+/*
+ * Where LED commands go: the hidraw node if the kernel driver is bound,
+ * otherwise a claimed USB handle
+ */
+typedef struct {
+    int fd;
+    libusb_device_handle *handle;
+} ledout;
+
+static int open_ledout(wheelstruct *w, ledout *out)
+{
+    out->handle = 0;
+    out->fd = open_wheel_hidraw(w);
+    if (out->fd != -1)
+        return 0;
+
+    out->handle = libusb_open_device_with_vid_pid(NULL, VID_LOGITECH, w->native_pid);
+    if (!out->handle) {
+        printf("%s not found. Make sure it is set to native mode (use --native).\n", w->name);
+        return -1;
+    }
+    if (claim_wheel(out->handle) < 0) {
+        libusb_close(out->handle);
+        return -1;
+    }
+    if (verbose_flag) printf("No hidraw node found, claimed %s\n", w->name);
+    return 0;
+}
+
+static int send_leds(wheelstruct *w, ledout *out, int leds)
+{
+    cmdstruct c;
+    memset(&c, 0, sizeof(c));
+    w->get_leds_cmd(&c, leds);
+
+    if (out->fd != -1)
+        return send_command_hidraw(out->fd, c);
+    return send_command_claimed(out->handle, c);
+}
+
+static void close_ledout(ledout *out)
+{
+    if (out->fd != -1)
+        close(out->fd);
+    if (out->handle) {
+        release_wheel(out->handle);
+        libusb_close(out->handle);
+    }
+}
+
+int run_leds(wheelstruct *w, const char *shm_name, const int *thresholds, int duration_sec)
+{
+    ledout out;
+    int derived[NUM_LEDS];
+    int i;
+
+    if (!w->get_leds_cmd) {
+        printf("Sorry, %s has no rev LEDs.\n", w->name);
+        return -1;
+    }
+
+    if (open_ledout(w, &out) != 0)
+        return -1;
+
+    stop_leds = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    long long start = now_ns();
+    long long deadline = duration_sec ? start + duration_sec * 1000000000LL : 0;
+
+    // the writer creates the slot, so it is owned by the (unprivileged) game and not by us
+    rpmslot *slot = shm_slot_open_reader(shm_name, sizeof(rpmslot));
+    if (!slot)
+        printf("Waiting for %s to be created by the game or telemetry bridge...\n", shm_name);
+    while (!slot && !stop_leds && (!deadline || now_ns() < deadline)) {
+        usleep(LED_SLOT_WAIT_MS * 1000);
+        slot = shm_slot_open_reader(shm_name, sizeof(rpmslot));
+    }
+    if (!slot) {
+        close_ledout(&out);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        return -1;
+    }
+
+    printf("Driving LEDs of %s from %s", w->name, shm_name);
+    if (thresholds) {
+        printf(", thresholds:");
+        for (i = 0; i < NUM_LEDS; i++)
+            printf(" %d", thresholds[i]);
+    }
+    printf("\n");
+
+    start = now_ns();                    // report from here, not from the wait for the slot
+    long long start_cpu = cpu_ns();
+    unsigned int lastSeq = 0;
+    int leds = -1;                       // unknown, so the first pattern is always sent
+    unsigned long long polls = 0, updates = 0, writes = 0, timed = 0;
+    long long latencySum = 0, latencyMax = 0;
+    long long writeSum = 0, writeMax = 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!stop_leds) {
+        polls++;
+        // cheap check of the sequence counter, only copy the slot if it changed
+        unsigned int seq = *(volatile unsigned int *)&slot->seq;
+        if (seq != lastSeq || leds < 0) {
+            rpmslot cur;
+            if (shm_slot_read(slot, &cur, sizeof(rpmslot)) != 0) {
+                printf("Writer of %s died within an update, stopping.\n", shm_name);
+                break;
+            }
+            lastSeq = cur.seq;
+            updates++;
+
+            const int *t = thresholds;
+            if (!t) {
+                for (i = 0; i < NUM_LEDS; i++)
+                    derived[i] = cur.redline > 0 ? cur.redline * default_percent[i] / 100 : 0x7fffffff;
+                t = derived;
+            }
+            int pattern = leds_for_rpm(cur.rpm, t);
+            if (pattern != leds) {
+                long long write_start = now_ns();
+                if (send_leds(w, &out, pattern) < 0)
+                    break;
+                long long done = now_ns();
+                leds = pattern;
+                writes++;
+                writeSum += done - write_start;
+                if (done - write_start > writeMax)
+                    writeMax = done - write_start;
+                if (cur.updated_ns > 0 && cur.updated_ns <= done) {
+                    long long latency = done - cur.updated_ns;
+                    latencySum += latency;
+                    if (latency > latencyMax)
+                        latencyMax = latency;
+                    timed++;
+                }
+                if (verbose_flag) printf("rpm %d -> LEDs 0x%02x\n", cur.rpm, pattern);
+            }
+        }
+
+        long long now = now_ns();
+        if (deadline && now >= deadline)
+            break;
+        next.tv_nsec += LED_POLL_US * 1000;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        // do not try to catch up after a stall (e.g. a slow USB write)
+        if ((long long)next.tv_sec * 1000000000LL + next.tv_nsec < now) {
+            next.tv_sec = now / 1000000000LL;
+            next.tv_nsec = now % 1000000000LL;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR && !stop_leds)
+            ;
+    }
+
+    // leave LEDs dark
+    if (leds > 0)
+        send_leds(w, &out, 0);
+
+    double elapsed = (now_ns() - start) / 1e9;
+    long long cpu = cpu_ns() - start_cpu;
+    printf("%llu polls, %llu rpm updates, %llu LED commands in %.1f s (%.1f commands/s)\n", polls, updates, writes,
+           elapsed, elapsed > 0 ? writes / elapsed : 0.0);
+    printf("CPU: %.2f%% (%lld ms)\n", elapsed > 0 ? cpu / 1e7 / elapsed : 0.0, cpu / 1000000);
+    if (writes)
+        printf("LED write: avg %lld us, max %lld us\n", writeSum / (long long)writes / 1000, writeMax / 1000);
+    if (timed)
+        printf("Rpm update to LED write: avg %lld us, max %lld us\n", latencySum / (long long)timed / 1000,
+               latencyMax / 1000);
+
+    close_ledout(&out);
+    shm_slot_close(slot, sizeof(rpmslot));
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef leds_h
+#define leds_h
+
+#include "wheels.h"
+
+#define RPM_SHM_NAME "/ltwheelconf-rpm"
+#define NUM_LEDS 5
+#define LED_POLL_US 1000                 /* how often the rpm slot is checked */
+#define LED_SLOT_WAIT_MS 100             /* how often to look for the rpm slot until the writer created it */
+
+/*
+ * Layout of the shared memory slot the rpm is read from, created and written by the
+ * game or a telemetry bridge. See shmslot.h on how to update it consistently.
+ */
+typedef struct {
+    unsigned int seq;
+    int rpm;
+    int redline;                         /* used for the default thresholds, 0 if unknown */
+    long long updated_ns;                /* CLOCK_MONOTONIC time of the update, 0 if unknown */
+} rpmslot;
+
+/*
+ * LED pattern for rpm: LED n lights up once rpm reaches thresholds[n].
+ * Thresholds have to be ascending.
+ */
+int leds_for_rpm(int rpm, const int *thresholds);
+
+/*
+ * Parse comma separated list of NUM_LEDS ascending thresholds.
+ * Returns 0 on success, -1 if list is invalid.
+ */
+int parse_thresholds(char *list, int *thresholds);
+
+/*
+ * Drive the rev LEDs of the wheel from the rpm published in shared memory slot shm_name.
+ *
+ * thresholds are NUM_LEDS rpm values, if 0 they are derived from the redline found in
+ * the slot (75%, 80%, 85%, 90% and 95%). The LED command is only sent when the pattern
+ * changes. It is written to the wheel's hidraw node, so the kernel driver stays bound;
+ * only if there is none the wheel is claimed for the whole run.
+ * The slot is only read; if the writer has not created it yet, it is waited for.
+ * Update rate, CPU use and time from rpm update to write are reported when done.
+ *
+ * duration_sec = 0 runs until interrupted.
+ */
+int run_leds(wheelstruct *w, const char *shm_name, const int *thresholds, int duration_sec);
+
+#endif
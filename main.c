@@ -25,9 +25,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "wheels.h"
 #include "wheelfunctions.h"
+#include "inventory.h"
+#include "aggregator.h"
+#include "calibration.h"
+#include "shifter.h"
+#include "recording.h"
+#include "ffmixer.h"
+#include "coalescer.h"
+#include "leds.h"
+#include "stats.h"
+#include "ffbench.h"
+#include "snapshot.h"
+#include "export.h"
+#include "virtwheel.h"
+#include "ffproxy.h"
 
 /* Globals */
 int verbose_flag = 0;
@@ -44,6 +59,9 @@ void help() {
     -v, --verbose               Verbose output\n\
                                 Use -vv to get debug messages from libusb\n\
     -l, --list                  List all found/supported devices\n\
+    -j, --json                  Use in conjunction with --list. Print inventory (bus, port path, pid, mode, release number,\n\
+                                product, serial, event and hidraw nodes, current range) as JSON.\n\
+                                Descriptors are read from sysfs or a cache, so polling this causes no USB traffic.\n\
     \n\
     Wheel configuration: \n\
     -w, --wheel=shortname       Which wheel is connected. Supported values:\n\
@@ -69,6 +87,12 @@ void help() {
                                 Value should be between 0 and 7\n\
                                 Low value means the centering force is increasing only slightly when turning the wheel.\n\
                                 High value means the centering force is increasing very fast when turning the wheel.\n\
+    -Q, --queue                 Read settings from stdin, one per line ('range <degrees>' or 'autocenter <value> <rampspeed>'),\n\
+                                e.g. from a slider of a control panel. Rapid changes collapse to the newest value and the wheel\n\
+                                stays claimed while they keep coming.\n\
+                                Note: \n\
+                                    -> Requires wheel to be in native (-n) mode!\n\
+    -I, --interval=ms           Send each queued setting at most once per interval (default: 50 ms)\n\
     -b, --altautocenter=value   Set autocenter force using generic input interface. Value should be between 0 and 100 (0 -> no autocenter, 100 -> max autocenter force). \n\
                                 Use this if --autocenter does not work for your device.\n\
                                 Note: \n\
@@ -79,6 +103,75 @@ void help() {
                                 Note: \n\
                                     -> Requires parameter '--device' to specify the input device\n\
     -d, --device=inputdevice    Specify inputdevice for force-feedback related configuration (--gain and --altautocenter)\n\
+    -M, --ffmixer               Run force feedback mixer for the input device: combine force feedback updates of several\n\
+                                local clients and pace them to the rate of the wheel's USB endpoint.\n\
+                                While it is running --gain and --altautocenter are handed to the mixer.\n\
+                                Only root and members of group '" FFMIXER_GROUP "' can send to the mixer.\n\
+                                Note: \n\
+                                    -> Requires parameter '--device' to specify the input device\n\
+    -F, --ffproxy               Run force feedback proxy for the input device: the game uses a virtual clone of the wheel,\n\
+                                uploaded effects are kept and restored on the new input device whenever the kernel driver\n\
+                                is re-attached (e.g. by --range while the game is running). Reports every dropout.\n\
+                                Note: \n\
+                                    -> Requires parameter '--device' to specify the input device\n\
+    -B, --ffbench               Benchmark force feedback response: step and sine constant forces, measuring latency until\n\
+                                the wheel moves, rise time and achievable update rate for a sweep of autocenter settings.\n\
+                                Use together with '--autocenter' and '--rampspeed' to benchmark only that setting, which is\n\
+                                applied before the benchmark and kept.\n\
+                                Note: \n\
+                                    -> Requires parameters '--wheel' and '--device', the wheel has to turn freely\n\
+    -k, --snapshot=file         Store configuration of the wheel in file: mode, range and axis limits are read from the wheel,\n\
+                                autocenter, rampspeed and gain are taken from the other options given (they are only stored,\n\
+                                not applied to the wheel).\n\
+                                Note: \n\
+                                    -> Requires parameter '--wheel', '--device' is looked up if not given\n\
+    -K, --restore=file          Restore configuration from snapshot file in one batch (mode switch, one USB command session,\n\
+                                one event device session) and report how long every step took.\n\
+    -c, --calibrate             Capture axis calibration: measure noise at rest, then sweep wheel and pedals over their full range.\n\
+                                Calibration is stored per wheel in " STATE_DIR ".\n\
+                                Note: \n\
+                                    -> Requires parameter '--device' to specify the input device\n\
+                                    -> Use --duration to change sweep time (default: 15 seconds)\n\
+    -C, --applycalibration      Apply stored calibration (min, max, fuzz, flat of all axes) to the input device,\n\
+                                so games read already calibrated axes.\n\
+                                Note: \n\
+                                    -> Requires parameter '--device' to specify the input device\n\
+    \n\
+    Telemetry: \n\
+    -A, --aggregate=devicelist  Read several event or hidraw devices (comma separated list, e.g. wheel, pedals and shifter)\n\
+                                in a single thread and merge their samples into one stream ordered by timestamp.\n\
+                                Uses io_uring (falls back to epoll). Reports throughput and latency when done.\n\
+                                Use --verbose to print every sample.\n\
+    -S, --shifter               Decode H-shifter of G25/G27 and publish current gear to shared memory.\n\
+                                Note: \n\
+                                    -> Requires parameters '--wheel' and '--device', wheel has to be in native mode\n\
+    -D, --debounce=ms           Time a new gear has to be stable before it is published (default: 20 ms)\n\
+    -L, --leds                  Drive rev LEDs of the G27 from the rpm published to a shared memory slot by a game or bridge.\n\
+                                LEDs are only updated when the pattern changes. Reports update rate, CPU use and latency.\n\
+                                Note: \n\
+                                    -> Requires parameter '--wheel', wheel has to be in native mode\n\
+    -E, --thresholds=list       Rpm at which each of the 5 LEDs lights up, comma separated and ascending\n\
+                                (default: 75%, 80%, 85%, 90% and 95% of the redline published in the slot)\n\
+    -m, --shm=name              Name of shared memory slot used by --shifter (default: " GEAR_SHM_NAME ")\n\
+                                or --leds (default: " RPM_SHM_NAME ")\n\
+    -R, --record=file           Record all input of the device given by '--device' (wheel, pedals, shifter) to file.\n\
+                                Samples are delta encoded in independent blocks, so hours of 1 kHz input stay small.\n\
+    -P, --replay=file           Replay a recording into a virtual clone (uinput) of the recorded device.\n\
+    -X, --speed=factor          Replay speed, 1 keeps original timing (default), 0 replays as fast as possible\n\
+    -T, --start=seconds         Start replay at given offset into the recording\n\
+    -O, --export=file           Convert a recording into a columnar file for analysis: one row per input frame with time,\n\
+                                steering angle in degrees, every other axis scaled to 0..1 and gear.\n\
+                                Use '--wheel' and '--range' if the recorded wheel or its range can not be detected.\n\
+    -o, --output=file           File written by --export (default: recording file name with .col appended)\n\
+    -V, --virtual               Create a virtual wheel (uinput) looking like the wheel in native mode and simulate it at\n\
+                                1 kHz: uploaded constant forces, gain and autocenter move the simulated ABS_X axis.\n\
+                                The event device is printed, use it with '--device' to test without hardware.\n\
+                                Use '--range' to set the simulated rotation range.\n\
+                                Note: \n\
+                                    -> Requires parameter '--wheel'\n\
+    -t, --duration=seconds      Stop telemetry modes after given number of seconds (default: run until interrupted)\n\
+    -z, --stats=file            Write runtime statistics (USB transfers, driver rebinds, re-enumeration waits, event\n\
+                                device write latency, input samples) to file in Prometheus text format, every second.\n\
     \n\
     Note: You can freely combine all configuration options.\n\
     \n\
@@ -110,9 +203,37 @@ int main (int argc, char **argv)
     int do_alt_autocenter = 0;
     int do_gain = 0;
     int do_list = 0;
+    int do_json = 0;
     int rampspeed = -1;
     int do_help = 0;
     int do_reset = 0;
+    int do_aggregate = 0;
+    int do_calibrate = 0;
+    int do_shifter = 0;
+    int do_replay = 0;
+    int do_ffmixer = 0;
+    int do_ffproxy = 0;
+    int do_queue = 0;
+    int do_ffbench = 0;
+    int do_leds = 0;
+    int do_virtual = 0;
+    int thresholds[NUM_LEDS];
+    int use_thresholds = 0;
+    int interval = COALESCE_INTERVAL_MS;
+    char *record_file = 0;
+    char *replay_file = 0;
+    double speed = 1.0;
+    int start_sec = 0;
+    int debounce = GEAR_DEBOUNCE_MS;
+    char *shm_name = 0;
+    int do_apply_calibration = 0;
+    int duration = 0;
+    char *aggregate_list = 0;
+    char *stats_file = 0;
+    char *snapshot_file = 0;
+    char *restore_file = 0;
+    char *export_file = 0;
+    char *output_file = 0;
     char device_file_name[128];
     char shortname[255];
     memset(device_file_name, 0, sizeof(device_file_name));
@@ -123,6 +244,7 @@ int main (int argc, char **argv)
         {"verbose",         no_argument,       0,               'v'},
         {"help",            no_argument,       0,               'h'},
         {"list",            no_argument,       0,               'l'},
+        {"json",            no_argument,       0,               'j'},
         {"wheel",           required_argument, 0,               'w'},
         {"nativemode",      no_argument,       0,               'n'},
         {"range",           required_argument, 0,               'r'},
@@ -132,12 +254,36 @@ int main (int argc, char **argv)
         {"gain",            required_argument, 0,               'g'},
         {"device",          required_argument, 0,               'd'},
         {"reset",           no_argument,       0,               'x'},
+        {"calibrate",       no_argument,       0,               'c'},
+        {"applycalibration",no_argument,       0,               'C'},
+        {"aggregate",       required_argument, 0,               'A'},
+        {"shifter",         no_argument,       0,               'S'},
+        {"debounce",        required_argument, 0,               'D'},
+        {"shm",             required_argument, 0,               'm'},
+        {"ffmixer",         no_argument,       0,               'M'},
+        {"ffproxy",         no_argument,       0,               'F'},
+        {"ffbench",         no_argument,       0,               'B'},
+        {"queue",           no_argument,       0,               'Q'},
+        {"interval",        required_argument, 0,               'I'},
+        {"leds",            no_argument,       0,               'L'},
+        {"thresholds",      required_argument, 0,               'E'},
+        {"record",          required_argument, 0,               'R'},
+        {"replay",          required_argument, 0,               'P'},
+        {"speed",           required_argument, 0,               'X'},
+        {"start",           required_argument, 0,               'T'},
+        {"duration",        required_argument, 0,               't'},
+        {"stats",           required_argument, 0,               'z'},
+        {"snapshot",        required_argument, 0,               'k'},
+        {"restore",         required_argument, 0,               'K'},
+        {"export",          required_argument, 0,               'O'},
+        {"output",          required_argument, 0,               'o'},
+        {"virtual",         no_argument,       0,               'V'},
         {0,                 0,                 0,               0  }
     };
 
     while (optind < argc) {
         int index = -1;
-        int result = getopt_long (argc, argv, "vhlw:nr:a:g:d:s:b:x",
+        int result = getopt_long (argc, argv, "vhljw:nr:a:g:d:s:b:xcCMFBQI:LE:A:SD:m:R:P:X:T:t:z:k:K:O:o:V",
                                   long_options, &index);
 
         if (result == -1)
@@ -177,13 +323,95 @@ int main (int argc, char **argv)
                 case 'l':
                     do_list = 1;
                     break;
+                case 'j':
+                    do_json = 1;
+                    break;
                 case 'w':
-                    strncpy(shortname, optarg, 255);
+                    strncpy(shortname, optarg, 254);
+                    shortname[254] = 0;
                     do_validate_wheel = 1;
                     break;
                 case 'x':
                     do_reset = 1;
                     break;
+                case 'c':
+                    do_calibrate = 1;
+                    break;
+                case 'C':
+                    do_apply_calibration = 1;
+                    break;
+                case 'A':
+                    aggregate_list = optarg;
+                    do_aggregate = 1;
+                    break;
+                case 'S':
+                    do_shifter = 1;
+                    break;
+                case 'D':
+                    debounce = atoi(optarg);
+                    break;
+                case 'm':
+                    shm_name = optarg;
+                    break;
+                case 'M':
+                    do_ffmixer = 1;
+                    break;
+                case 'F':
+                    do_ffproxy = 1;
+                    break;
+                case 'B':
+                    do_ffbench = 1;
+                    break;
+                case 'Q':
+                    do_queue = 1;
+                    break;
+                case 'I':
+                    interval = atoi(optarg);
+                    break;
+                case 'L':
+                    do_leds = 1;
+                    break;
+                case 'E':
+                    if (parse_thresholds(optarg, thresholds) != 0) {
+                        printf("Please provide %d ascending thresholds for '--thresholds'\n", NUM_LEDS);
+                        do_help = 1;
+                    }
+                    use_thresholds = 1;
+                    break;
+                case 'R':
+                    record_file = optarg;
+                    break;
+                case 'P':
+                    replay_file = optarg;
+                    do_replay = 1;
+                    break;
+                case 'X':
+                    speed = atof(optarg);
+                    break;
+                case 'T':
+                    start_sec = atoi(optarg);
+                    break;
+                case 't':
+                    duration = atoi(optarg);
+                    break;
+                case 'z':
+                    stats_file = optarg;
+                    break;
+                case 'k':
+                    snapshot_file = optarg;
+                    break;
+                case 'K':
+                    restore_file = optarg;
+                    break;
+                case 'O':
+                    export_file = optarg;
+                    break;
+                case 'o':
+                    output_file = optarg;
+                    break;
+                case 'V':
+                    do_virtual = 1;
+                    break;
                 case '?':
                 default:
                     do_help = 1;
@@ -198,6 +426,9 @@ int main (int argc, char **argv)
         if (verbose_flag > 1)
             libusb_set_debug(0, 3);
 
+        if (stats_file && !do_help)
+            stats_start(stats_file);
+
         int wait_for_udev = 0;
         wheelstruct* wheel = 0;
 
@@ -205,18 +436,40 @@ int main (int argc, char **argv)
             help();
         } else if (do_list) {
             // list all devices, ignore other options...
-            list_devices();
+            if (do_json)
+                list_devices_json();
+            else
+                list_devices();
+        } else if (do_aggregate) {
+            char *devices[MAX_AGGREGATE_DEVICES];
+            int numDevices = 0;
+            char *token = strtok(aggregate_list, ",");
+            while (token && numDevices < MAX_AGGREGATE_DEVICES) {
+                devices[numDevices++] = token;
+                token = strtok(NULL, ",");
+            }
+            aggregate_devices(devices, numDevices, duration);
+        } else if (do_replay) {
+            replay_session(replay_file, speed, start_sec);
+        } else if (export_file) {
+            char name[512];
+            wheelstruct *export_wheel = do_validate_wheel ? find_wheel(shortname) : 0;
+            if (!output_file) {
+                snprintf(name, sizeof(name), "%.500s.col", export_file);
+                output_file = name;
+            }
+            export_recording(export_file, output_file, export_wheel, do_range ? range : 0);
+        } else if (do_virtual) {
+            wheelstruct *virtual_wheel = do_validate_wheel ? find_wheel(shortname) : 0;
+            if (!virtual_wheel)
+                printf("Please provide --wheel parameter!\n");
+            else
+                run_virtual_wheel(virtual_wheel, do_range ? range : 0, duration);
+        } else if (restore_file) {
+            restore_snapshot(restore_file, device_file_name);
         } else {
             if (do_validate_wheel) {
-                int numWheels = sizeof(wheels)/sizeof(wheelstruct);
-                int i = 0;
-                for (i=0; i < numWheels; i++) {
-                    if (strncasecmp(wheels[i].shortname, shortname, 255) == 0) {
-                        // found matching wheel
-                        wheel = &(wheels[i]);
-                        break;
-                    }
-                }
+                wheel = find_wheel(shortname);
                 if (!wheel) {
                     printf("Wheel \"%s\" not supported. Did you spell the shortname correctly?\n", shortname);
                 }
@@ -240,7 +493,7 @@ int main (int argc, char **argv)
                 }
             }
 
-            if (do_range) {
+            if (do_range && !snapshot_file) {
                 if (!wheel) {
                     printf("Please provide --wheel parameter!\n");
                 } else {
@@ -249,7 +502,7 @@ int main (int argc, char **argv)
                 }
             }
 
-            if (do_autocenter) {
+            if (do_autocenter && !snapshot_file) {
                 if (!wheel) {
                     printf("Please provide --wheel parameter!\n");
                 } else {
@@ -265,7 +518,17 @@ int main (int argc, char **argv)
                 }
             }
 
-            if (do_alt_autocenter) {
+            if (do_queue) {
+                if (!wheel) {
+                    printf("Please provide --wheel parameter!\n");
+                } else {
+                    if (wait_for_udev) wait_udev();
+                    run_setting_queue(wheel, interval);
+                    wait_for_udev = 1;
+                }
+            }
+
+            if (do_alt_autocenter && !snapshot_file) {
                 if (strlen(device_file_name)) {
                     alt_set_autocenter(centerforce, device_file_name, wait_for_udev);
                     wait_for_udev = 0;
@@ -274,7 +537,7 @@ int main (int argc, char **argv)
                 }
             }
 
-            if (do_gain) {
+            if (do_gain && !snapshot_file) {
                 if (strlen(device_file_name)) {
                     set_gain(gain, device_file_name, wait_for_udev);
                     wait_for_udev = 0;
@@ -282,7 +545,107 @@ int main (int argc, char **argv)
                     printf("Please provide the according event interface for your wheel using '--device' parameter (E.g. '--device /dev/input/event0')\n");
                 }
             }
+
+            if (do_calibrate) {
+                if (strlen(device_file_name)) {
+                    if (wait_for_udev) wait_udev();
+                    calibrate(device_file_name, duration ? duration : CALIBRATION_SWEEP_SEC);
+                    wait_for_udev = 0;
+                } else {
+                    printf("Please provide the according event interface for your wheel using '--device' parameter (E.g. '--device /dev/input/event0')\n");
+                }
+            }
+
+            if (do_apply_calibration) {
+                if (strlen(device_file_name)) {
+                    apply_calibration(device_file_name, wait_for_udev);
+                    wait_for_udev = 0;
+                } else {
+                    printf("Please provide the according event interface for your wheel using '--device' parameter (E.g. '--device /dev/input/event0')\n");
+                }
+            }
+
+            if (do_ffmixer) {
+                if (strlen(device_file_name)) {
+                    if (wait_for_udev) wait_udev();
+                    run_ffmixer(device_file_name, duration);
+                    wait_for_udev = 0;
+                } else {
+                    printf("Please provide the according event interface for your wheel using '--device' parameter (E.g. '--device /dev/input/event0')\n");
+                }
+            }
+
+            if (do_ffproxy) {
+                if (strlen(device_file_name)) {
+                    if (wait_for_udev) wait_udev();
+                    run_ffproxy(device_file_name, duration);
+                    wait_for_udev = 0;
+                } else {
+                    printf("Please provide the according event interface for your wheel using '--device' parameter (E.g. '--device /dev/input/event0')\n");
+                }
+            }
+
+            if (record_file) {
+                if (strlen(device_file_name)) {
+                    if (wait_for_udev) wait_udev();
+                    record_session(device_file_name, record_file, duration);
+                    wait_for_udev = 0;
+                } else {
+                    printf("Please provide the according event interface for your wheel using '--device' parameter (E.g. '--device /dev/input/event0')\n");
+                }
+            }
+
+            if (do_shifter) {
+                if (!wheel) {
+                    printf("Please provide --wheel parameter!\n");
+                } else if (strlen(device_file_name)) {
+                    if (wait_for_udev) wait_udev();
+                    run_shifter(wheel, device_file_name, shm_name ? shm_name : GEAR_SHM_NAME, debounce, duration);
+                    wait_for_udev = 0;
+                } else {
+                    printf("Please provide the according event interface for your wheel using '--device' parameter (E.g. '--device /dev/input/event0')\n");
+                }
+            }
+
+            if (snapshot_file) {
+                if (!wheel) {
+                    printf("Please provide --wheel parameter!\n");
+                } else if (do_autocenter && centerforce != 0 && rampspeed == -1) {
+                    printf("Please provide '--rampspeed' parameter\n");
+                } else {
+                    if (wait_for_udev) wait_udev();
+                    take_snapshot(wheel, device_file_name, snapshot_file, do_range ? range : -1,
+                                  do_autocenter ? centerforce : -1, rampspeed, do_gain ? gain : -1,
+                                  do_alt_autocenter ? centerforce : -1);
+                    wait_for_udev = 0;
+                }
+            }
+
+            if (do_ffbench) {
+                if (!wheel) {
+                    printf("Please provide --wheel parameter!\n");
+                } else if (!strlen(device_file_name)) {
+                    printf("Please provide the according event interface for your wheel using '--device' parameter (E.g. '--device /dev/input/event0')\n");
+                } else if (do_autocenter && centerforce != 0 && rampspeed == -1) {
+                    printf("Please provide '--rampspeed' parameter\n");
+                } else {
+                    if (wait_for_udev) wait_udev();
+                    run_ffbench(wheel, device_file_name, do_autocenter ? centerforce : -1, rampspeed);
+                    wait_for_udev = 0;
+                }
+            }
+
+            if (do_leds) {
+                if (!wheel) {
+                    printf("Please provide --wheel parameter!\n");
+                } else {
+                    if (wait_for_udev) wait_udev();
+                    run_leds(wheel, shm_name ? shm_name : RPM_SHM_NAME, use_thresholds ? thresholds : 0, duration);
+                    wait_for_udev = 0;
+                }
+            }
         }
+        stats_stop();
         libusb_exit(NULL);
     } else {
         // display usage information if no arguments given
@@ -0,0 +1,473 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <linux/input.h>
+
+#include "uinputdev.h"
+#include "recording.h"
+#include "stats.h"
+
+/* Globals */
+extern int verbose_flag;
+
+static volatile sig_atomic_t stop_session = 0;
+
+static void handle_stop(int sig)
+{
+    stop_session = 1;
+}
+
+static long long now_us(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+
+/*
+ * Encoding
+ */
+static int put_varint(unsigned char *buf, unsigned long long v)
+{
+    int len = 0;
+    while (v >= 0x80) {
+        buf[len++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    buf[len++] = v;
+    return len;
+}
+
+static unsigned long long get_varint(unsigned char *buf, size_t *pos, size_t end)
+{
+    unsigned long long v = 0;
+    int shift = 0;
+    while (*pos < end && shift < 64) {
+        unsigned char b = buf[(*pos)++];
+        v |= (unsigned long long)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            break;
+        shift += 7;
+    }
+    return v;
+}
+
+static unsigned long long zigzag(long long v)
+{
+    return ((unsigned long long)v << 1) ^ (v >> 63);
+}
+
+static long long unzigzag(unsigned long long v)
+{
+    return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+typedef struct {
+    int fd;
+    recblock header;
+    unsigned char buf[REC_BLOCK_BYTES];
+    size_t len;
+    long long prev_us;
+    int last[ABS_CNT];
+    unsigned long long samples;
+    unsigned long long bytes;
+} recwriter;
+
+static int flush_block(recwriter *w)
+{
+    if (!w->header.count)
+        return 0;
+    w->header.magic = REC_BLOCK_MAGIC;
+    w->header.size = w->len;
+    w->header.last_us = w->prev_us;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &w->header;
+    iov[0].iov_len = sizeof(recblock);
+    iov[1].iov_base = w->buf;
+    iov[1].iov_len = w->len;
+    size_t total = sizeof(recblock) + w->len;
+    if (writev(w->fd, iov, 2) != total) {
+        perror("Write recording");
+        return -1;
+    }
+    w->bytes += total;
+    memset(&w->header, 0, sizeof(recblock));
+    memset(w->last, 0, sizeof(w->last));
+    w->len = 0;
+    return 0;
+}
+
+static int add_sample(recwriter *w, long long us, struct input_event *ev)
+{
+    // worst case size of one sample
+    if (w->len + 32 > REC_BLOCK_BYTES && flush_block(w) != 0)
+        return -1;
+    if (!w->header.count) {
+        w->header.first_us = us;
+        w->prev_us = us;
+    }
+    long long value = ev->value;
+    if (ev->type == EV_ABS && ev->code < ABS_CNT) {
+        value = ev->value - w->last[ev->code];
+        w->last[ev->code] = ev->value;
+    }
+    w->len += put_varint(w->buf + w->len, us > w->prev_us ? us - w->prev_us : 0);
+    w->buf[w->len++] = ev->type;
+    w->len += put_varint(w->buf + w->len, ev->code);
+    w->len += put_varint(w->buf + w->len, zigzag(value));
+    if (us > w->prev_us)
+        w->prev_us = us;
+    w->header.count++;
+    w->samples++;
+    return 0;
+}
+
+int record_session(char *device_file_name, char *file_name, int duration_sec)
+{
+    recheader header;
+    int clk = CLOCK_MONOTONIC;
+    clockid_t evclock = CLOCK_MONOTONIC;
+    int samples = stats_counter("ltwheelconf_input_samples_total", "mode=\"record\"", "Input samples read");
+
+    int fd = open(device_file_name, O_RDONLY);
+    if (fd == -1) {
+        perror("Open device file");
+        return -1;
+    }
+    if (ioctl(fd, EVIOCSCLOCKID, &clk) != 0) {
+        // old kernel, event timestamps use wall clock
+        if (verbose_flag) printf("Device %s: unable to switch to monotonic timestamps.\n", device_file_name);
+        evclock = CLOCK_REALTIME;
+    }
+
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, REC_MAGIC);
+    header.version = REC_VERSION;
+    header.header_size = sizeof(header);
+    header.start_realtime_us = now_us(CLOCK_REALTIME);
+    if (read_devcaps(fd, &header.caps) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    recwriter *w = calloc(1, sizeof(recwriter));
+    if (!w) {
+        perror("Allocate recording buffer");
+        close(fd);
+        return -1;
+    }
+    w->fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (w->fd == -1 || write(w->fd, &header, sizeof(header)) != sizeof(header)) {
+        perror(file_name);
+        if (w->fd != -1) close(w->fd);
+        free(w);
+        close(fd);
+        return -1;
+    }
+    w->bytes = sizeof(header);
+
+    printf("Recording \"%s\" to %s...\n", header.caps.name, file_name);
+    stop_session = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    long long start = now_us(evclock);
+    long long deadline = duration_sec ? start + duration_sec * 1000000LL : 0;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (!stop_session) {
+        long long now = now_us(evclock);
+        if (deadline && now >= deadline)
+            break;
+        // close block after REC_BLOCK_MS even if the device is idle
+        if (w->header.count && now - start - w->header.first_us >= REC_BLOCK_MS * 1000LL && flush_block(w) != 0)
+            break;
+
+        int ret = poll(&pfd, 1, REC_BLOCK_MS / 4);
+        if (ret < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (ret <= 0)
+            continue;
+
+        struct input_event ev[64];
+        ssize_t len = read(fd, ev, sizeof(ev));
+        if (len <= 0) {
+            if (len < 0) perror("Read device");
+            break;
+        }
+        int numEvents = len / sizeof(struct input_event);
+        int e;
+        for (e = 0; e < numEvents; e++) {
+            long long us = (long long)ev[e].time.tv_sec * 1000000LL + ev[e].time.tv_usec - start;
+            if (add_sample(w, us < 0 ? 0 : us, &ev[e]) != 0)
+                stop_session = 1;
+        }
+        stats_add(samples, numEvents);
+    }
+    flush_block(w);
+
+    double seconds = (now_us(evclock) - start) / 1e6;
+    printf("Recorded %llu samples in %.1f seconds, %llu bytes (%.2f bytes/sample).\n", w->samples, seconds, w->bytes,
+           w->samples ? (double)(w->bytes - sizeof(header)) / w->samples : 0);
+    close(w->fd);
+    free(w);
+    close(fd);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
+
+
+/*
+ * Reading
+ */
+int recording_open(const char *file_name, recording *rec)
+{
+    struct stat st;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->fd = open(file_name, O_RDONLY);
+    if (rec->fd == -1 || fstat(rec->fd, &st) != 0) {
+        perror(file_name);
+        return -1;
+    }
+    rec->size = st.st_size;
+    if (rec->size < sizeof(recheader)) {
+        printf("%s is not a recording.\n", file_name);
+        close(rec->fd);
+        return -1;
+    }
+    rec->map = mmap(0, rec->size, PROT_READ, MAP_SHARED, rec->fd, 0);
+    if (rec->map == MAP_FAILED) {
+        perror("Map recording");
+        close(rec->fd);
+        return -1;
+    }
+    rec->header = (recheader *)rec->map;
+    if (memcmp(rec->header->magic, REC_MAGIC, sizeof(REC_MAGIC)) != 0 || rec->header->version != REC_VERSION) {
+        printf("%s is not a recording or has an unsupported version.\n", file_name);
+        recording_close(rec);
+        return -1;
+    }
+
+    // hop over block headers to build the index, samples are not touched
+    size_t offset = rec->header->header_size;
+    int capacity = 0;
+    while (offset + sizeof(recblock) <= rec->size) {
+        recblock *b = (recblock *)(rec->map + offset);
+        if (b->magic != REC_BLOCK_MAGIC || offset + sizeof(recblock) + b->size > rec->size) {
+            printf("Recording truncated after %d blocks.\n", rec->numBlocks);
+            break;
+        }
+        if (rec->numBlocks == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            rec->index = realloc(rec->index, capacity * sizeof(recindex));
+            if (!rec->index) {
+                perror("Allocate block index");
+                recording_close(rec);
+                return -1;
+            }
+        }
+        rec->index[rec->numBlocks].offset = offset;
+        rec->index[rec->numBlocks].first_us = b->first_us;
+        rec->numBlocks++;
+        rec->numSamples += b->count;
+        rec->duration_us = b->last_us;
+        offset += sizeof(recblock) + b->size;
+    }
+    madvise(rec->map, rec->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void recording_close(recording *rec)
+{
+    if (rec->map && rec->map != MAP_FAILED)
+        munmap(rec->map, rec->size);
+    free(rec->index);
+    close(rec->fd);
+    memset(rec, 0, sizeof(*rec));
+    rec->fd = -1;
+}
+
+static void enter_block(reccursor *cur, int block)
+{
+    recording *rec = cur->rec;
+    cur->block = block;
+    if (block >= rec->numBlocks) {
+        cur->left = 0;
+        return;
+    }
+    recblock *b = (recblock *)(rec->map + rec->index[block].offset);
+    cur->pos = rec->index[block].offset + sizeof(recblock);
+    cur->end = cur->pos + b->size;
+    cur->left = b->count;
+    cur->us = b->first_us;
+    memset(cur->last, 0, sizeof(cur->last));
+}
+
+void recording_seek(recording *rec, reccursor *cur, long long us)
+{
+    int lo = 0, hi = rec->numBlocks - 1;
+
+    memset(cur, 0, sizeof(*cur));
+    cur->rec = rec;
+    // last block starting at or before us
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (rec->index[mid].first_us <= us)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    enter_block(cur, rec->numBlocks ? lo : 0);
+}
+
+int recording_next(reccursor *cur, recsample *sample)
+{
+    recording *rec = cur->rec;
+    while (!cur->left) {
+        if (cur->block >= rec->numBlocks)
+            return 0;
+        // release pages of the block just finished
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t from = rec->index[cur->block].offset & ~(page - 1);
+        size_t to = cur->end & ~(page - 1);
+        if (to > from)
+            madvise(rec->map + from, to - from, MADV_DONTNEED);
+        enter_block(cur, cur->block + 1);
+    }
+    cur->us += get_varint(rec->map, &cur->pos, cur->end);
+    sample->us = cur->us;
+    sample->type = cur->pos < cur->end ? rec->map[cur->pos++] : 0;
+    sample->code = get_varint(rec->map, &cur->pos, cur->end);
+    long long value = unzigzag(get_varint(rec->map, &cur->pos, cur->end));
+    if (sample->type == EV_ABS && sample->code < ABS_CNT) {
+        value += cur->last[sample->code];
+        cur->last[sample->code] = value;
+    }
+    sample->value = value;
+    cur->left--;
+    return 1;
+}
+
+
+/*
+ * Replay
+ */
+int replay_session(char *file_name, double speed, int start_sec)
+{
+    recording rec;
+    reccursor cur;
+    recsample sample;
+    struct input_event batch[64];
+    int numBatch = 0;
+
+    if (recording_open(file_name, &rec) != 0)
+        return -1;
+    printf("Recording of \"%s\": %llu samples in %d blocks, %.1f seconds.\n", rec.header->caps.name, rec.numSamples,
+           rec.numBlocks, rec.duration_us / 1e6);
+
+    // the clone only replays input, it can not take force feedback
+    devcaps caps = rec.header->caps;
+    caps.evbits[EV_FF / 8] &= ~(1 << (EV_FF % 8));
+    memset(caps.ffbits, 0, sizeof(caps.ffbits));
+    caps.ff_effects_max = 0;
+    int ufd = create_uinput(&caps);
+    if (ufd < 0) {
+        recording_close(&rec);
+        return -1;
+    }
+    // give udev and applications time to pick up the new device
+    sleep(1);
+
+    stop_session = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    long long base_us = start_sec * 1000000LL;
+    recording_seek(&rec, &cur, base_us);
+    long long start = now_us(CLOCK_MONOTONIC);
+    unsigned long long replayed = 0;
+    long long lateSum = 0, lateMax = 0;
+    unsigned long long batches = 0;
+
+    while (!stop_session && recording_next(&cur, &sample)) {
+        if (sample.us < base_us)
+            continue;
+        if (!numBatch && speed > 0) {
+            // wait until the first event of this batch is due
+            long long due = start + (long long)((sample.us - base_us) / speed);
+            struct timespec ts;
+            ts.tv_sec = due / 1000000LL;
+            ts.tv_nsec = (due % 1000000LL) * 1000;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !stop_session)
+                ;
+            long long late = now_us(CLOCK_MONOTONIC) - due;
+            lateSum += late;
+            if (late > lateMax)
+                lateMax = late;
+            batches++;
+        }
+        struct input_event *ev = &batch[numBatch++];
+        memset(ev, 0, sizeof(*ev));
+        ev->type = sample.type;
+        ev->code = sample.code;
+        ev->value = sample.value;
+        replayed++;
+        if ((sample.type == EV_SYN && sample.code == SYN_REPORT) || numBatch == 64) {
+            if (write(ufd, batch, numBatch * sizeof(struct input_event)) < 0)
+                perror("Write uinput");
+            numBatch = 0;
+        }
+    }
+    if (numBatch && write(ufd, batch, numBatch * sizeof(struct input_event)) < 0)
+        perror("Write uinput");
+
+    double seconds = (now_us(CLOCK_MONOTONIC) - start) / 1e6;
+    printf("Replayed %llu samples in %.1f seconds.\n", replayed, seconds);
+    if (batches)
+        printf("Timing error: avg %lld us, max %lld us late.\n", lateSum / (long long)batches, lateMax);
+
+    destroy_uinput(ufd);
+    recording_close(&rec);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef recording_h
+#define recording_h
+
+#include <stddef.h>
+#include <linux/input.h>
+
+#include "uinputdev.h"
+
+/*
+ * Session recording file format
+ *
+ * The file starts with a recheader holding the capabilities of the recorded
+ * device, followed by blocks. Every block has a recblock header and up to
+ * REC_BLOCK_BYTES of samples, it is written with a single append when full or
+ * REC_BLOCK_MS after its first sample. A crash therefore loses at most the last
+ * block, everything before stays readable.
+ *
+ * Samples are encoded relative to the previous sample of the same block:
+ *  varint   time delta in microseconds
+ *  byte     event type
+ *  varint   event code
+ *  varint   value, zigzag encoded; for EV_ABS as delta to the last value of that axis
+ *
+ * Blocks do not depend on each other, so seeking only needs to hop from block
+ * header to block header (first_us tells where a block starts in time) and
+ * decoding can start at any block.
+ */
+
+#define REC_MAGIC "LTWREC1"
+#define REC_VERSION 1
+#define REC_BLOCK_MAGIC 0x314b4c42       /* "BLK1" */
+#define REC_BLOCK_BYTES 65536
+#define REC_BLOCK_MS 1000
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int header_size;            /* offset of first block */
+    long long start_realtime_us;         /* wall clock time recording started */
+    devcaps caps;
+} recheader;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int size;                   /* bytes of samples following this header */
+    unsigned int count;                  /* number of samples */
+    unsigned int reserved;
+    long long first_us;                  /* time of first sample, relative to recording start */
+    long long last_us;
+} recblock;
+
+typedef struct {
+    long long us;                        /* relative to recording start */
+    unsigned short type;
+    unsigned short code;
+    int value;
+} recsample;
+
+typedef struct {
+    size_t offset;
+    long long first_us;
+} recindex;
+
+typedef struct {
+    int fd;
+    unsigned char *map;
+    size_t size;
+    recheader *header;
+    recindex *index;
+    int numBlocks;
+    unsigned long long numSamples;
+    long long duration_us;
+} recording;
+
+typedef struct {
+    recording *rec;
+    int block;
+    size_t pos;                          /* position of next sample in map */
+    size_t end;                          /* end of current block */
+    unsigned int left;                   /* samples left in current block */
+    long long us;
+    int last[ABS_CNT];
+} reccursor;
+
+/*
+ * Record all events of the input device into file.
+ * duration_sec = 0 records until interrupted.
+ */
+int record_session(char *device_file_name, char *file_name, int duration_sec);
+
+/*
+ * Replay recording into a uinput clone of the recorded device.
+ * speed 1.0 keeps original timing, 2.0 is twice as fast, 0 replays as fast as possible.
+ * Replay starts at start_sec into the recording.
+ */
+int replay_session(char *file_name, double speed, int start_sec);
+
+/*
+ * Map recording and build block index by hopping over block headers.
+ */
+int recording_open(const char *file_name, recording *rec);
+void recording_close(recording *rec);
+
+/*
+ * Position cursor at first block containing samples at or after us.
+ */
+void recording_seek(recording *rec, reccursor *cur, long long us);
+
+/*
+ * Decode next sample. Returns 1 on success, 0 at end of recording.
+ * Pages of blocks already decoded are released, so memory use stays bounded.
+ */
+int recording_next(reccursor *cur, recsample *sample);
+
+#endif
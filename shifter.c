@@ -0,0 +1,244 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include <linux/input.h>
+
+#include "wheels.h"
+#include "shmslot.h"
+#include "shifter.h"
+#include "stats.h"
+
+/* Globals */
+extern int verbose_flag;
+
+/*
+ * In native mode both wheels report the shifter positions as joystick buttons
+ * 8-13 (gear 1-6) and 14 (reverse), which evdev maps to BTN_JOYSTICK + button.
+ * Order: reverse, gear 1..6
+ */
+static const unsigned short gear_codes_G25_G27[NUM_GEARS + 1] = {
+    BTN_JOYSTICK + 14,
+    BTN_JOYSTICK + 8, BTN_JOYSTICK + 9, BTN_JOYSTICK + 10,
+    BTN_JOYSTICK + 11, BTN_JOYSTICK + 12, BTN_JOYSTICK + 13
+};
+
+static volatile sig_atomic_t stop_shifter = 0;
+
+static void handle_stop(int sig)
+{
+    stop_shifter = 1;
+}
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+const unsigned short *get_gear_codes(wheelstruct *w)
+{
+    if (strcasecmp(w->shortname, "G25") == 0 || strcasecmp(w->shortname, "G27") == 0)
+        return gear_codes_G25_G27;
+    return 0;
+}
+
+int decode_gear(unsigned int pressed)
+{
+    int i;
+    if (pressed & 1)
+        return GEAR_REVERSE;
+    for (i = 1; i <= NUM_GEARS; i++) {
+        if (pressed & (1 << i))
+            return i;
+    }
+    return GEAR_NEUTRAL;
+}
+
+static void publish_gear(gearslot *slot, int gear, long long event_ns)
+{
+    shm_slot_write_begin(&slot->seq);
+    slot->gear = gear;
+    slot->changed_ns = event_ns;
+    slot->changes++;
+    slot->published_ns = now_ns();
+    shm_slot_write_end(&slot->seq);
+}
+
+static const char *gear_name(int gear)
+{
+    static const char *names[] = { "R", "N", "1", "2", "3", "4", "5", "6" };
+    return names[gear + 1];
+}
+
+int run_shifter(wheelstruct *w, char *device_file_name, const char *shm_name, int debounce_ms, int duration_sec)
+{
+    const unsigned short *codes = get_gear_codes(w);
+    unsigned char keys[KEY_MAX / 8 + 1];
+    int clk = CLOCK_MONOTONIC;
+    int i;
+
+    if (!codes) {
+        printf("%s has no H-shifter.\n", w->name);
+        return -1;
+    }
+
+    int fd = open(device_file_name, O_RDONLY);
+    if (fd == -1) {
+        perror("Open device file");
+        return -1;
+    }
+    // event timestamps are compared with now_ns(), fall back to reading the clock if they can not be switched
+    int event_clock = ioctl(fd, EVIOCSCLOCKID, &clk) == 0;
+    if (!event_clock)
+        perror("Switch to monotonic timestamps, using time of read instead");
+
+    gearslot *slot = shm_slot_open(shm_name, sizeof(gearslot), 1);
+    if (!slot) {
+        close(fd);
+        return -1;
+    }
+
+    // start with the gear currently engaged
+    unsigned int pressed = 0;
+    memset(keys, 0, sizeof(keys));
+    if (ioctl(fd, EVIOCGKEY(sizeof(keys)), keys) >= 0) {
+        for (i = 0; i <= NUM_GEARS; i++) {
+            if (keys[codes[i] / 8] & (1 << (codes[i] % 8)))
+                pressed |= 1 << i;
+        }
+    }
+    int gear = decode_gear(pressed);
+    publish_gear(slot, gear, now_ns());
+    printf("Publishing gear of %s to %s, debounce %d ms. Current gear: %s\n", w->name, shm_name, debounce_ms,
+           gear_name(gear));
+
+    stop_shifter = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    long long deadline = duration_sec ? now_ns() + duration_sec * 1000000000LL : 0;
+    long long debounce_ns = debounce_ms * 1000000LL;
+    int samples = stats_counter("ltwheelconf_input_samples_total", "mode=\"shifter\"", "Input samples read");
+    int candidate = gear;                // gear waiting to become stable
+    long long candidate_ns = 0;          // event timestamp candidate was seen first
+    unsigned long long published = 0;
+    long long decodeSum = 0, decodeMax = 0;
+    long long latencySum = 0, latencyMax = 0;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (!stop_shifter) {
+        long long now = now_ns();
+        int timeout = -1;
+        if (candidate != gear) {
+            long long wait = candidate_ns + debounce_ns - now;
+            timeout = wait > 0 ? (wait + 999999) / 1000000 : 0;
+        }
+        if (deadline) {
+            int left = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+            if (timeout < 0 || left < timeout)
+                timeout = left;
+            if (!left)
+                break;
+        }
+
+        int ret = poll(&pfd, 1, timeout);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+        long long decode_start = now_ns();
+
+        if (ret > 0) {
+            struct input_event ev[64];
+            ssize_t len = read(fd, ev, sizeof(ev));
+            if (len <= 0) {
+                if (len < 0) perror("Read device");
+                break;
+            }
+            int numEvents = len / sizeof(struct input_event);
+            int e;
+            stats_add(samples, numEvents);
+            for (e = 0; e < numEvents; e++) {
+                if (ev[e].type != EV_KEY)
+                    continue;
+                for (i = 0; i <= NUM_GEARS; i++) {
+                    if (ev[e].code != codes[i])
+                        continue;
+                    if (ev[e].value)
+                        pressed |= 1 << i;
+                    else
+                        pressed &= ~(1 << i);
+                    int decoded = decode_gear(pressed);
+                    if (decoded != candidate) {
+                        candidate = decoded;
+                        if (event_clock)
+                            candidate_ns = (long long)ev[e].time.tv_sec * 1000000000LL + ev[e].time.tv_usec * 1000LL;
+                        else
+                            candidate_ns = decode_start;
+                    }
+                }
+            }
+        }
+
+        // publish once the candidate was stable for the debounce window
+        if (candidate != gear && decode_start - candidate_ns >= debounce_ns) {
+            gear = candidate;
+            publish_gear(slot, gear, candidate_ns);
+            long long decode = slot->published_ns - decode_start;
+            long long latency = slot->published_ns - candidate_ns;
+            decodeSum += decode;
+            latencySum += latency;
+            if (decode > decodeMax)
+                decodeMax = decode;
+            if (latency > latencyMax)
+                latencyMax = latency;
+            published++;
+            if (verbose_flag) printf("Gear %s (decode to publish %lld ns, event to publish %lld us)\n",
+                                     gear_name(gear), decode, latency / 1000);
+        }
+    }
+
+    printf("Published %llu gear changes.\n", published);
+    if (published) {
+        printf("Decode to publish: avg %lld ns, max %lld ns\n", decodeSum / (long long)published, decodeMax);
+        printf("Event to publish (including %d ms debounce): avg %lld us, max %lld us\n", debounce_ms,
+               latencySum / (long long)published / 1000, latencyMax / 1000);
+    }
+    shm_slot_close(slot, sizeof(gearslot));
+    close(fd);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef shifter_h
+#define shifter_h
+
+#include "wheels.h"
+
+#define GEAR_SHM_NAME "/ltwheelconf-gear"
+#define GEAR_DEBOUNCE_MS 20
+#define GEAR_NEUTRAL 0
+#define GEAR_REVERSE -1
+#define NUM_GEARS 6
+
+/*
+ * Layout of the shared memory slot the gear state is published to.
+ * See shmslot.h on how to read it consistently.
+ */
+typedef struct {
+    unsigned int seq;
+    int gear;                            /* GEAR_REVERSE, GEAR_NEUTRAL or 1..NUM_GEARS */
+    long long changed_ns;                /* CLOCK_MONOTONIC timestamp of the input event causing the change */
+    long long published_ns;              /* CLOCK_MONOTONIC time the change was published */
+    unsigned long long changes;
+} gearslot;
+
+/*
+ * Evdev key codes of the H-shifter positions of a wheel.
+ * Returns 0 if the wheel has no H-shifter.
+ */
+const unsigned short *get_gear_codes(wheelstruct *w);
+
+/*
+ * Gear selected by the pressed gear buttons, pressed is a bitmask
+ * (bit 0: reverse, bit n: gear n)
+ */
+int decode_gear(unsigned int pressed);
+
+/*
+ * Decode H-shifter of G25/G27 from the event device and publish the current gear
+ * to shared memory slot shm_name.
+ *
+ * A new gear is only published once it was stable for debounce_ms. The time from
+ * decoding the input event to publishing is measured and reported when done.
+ * The wheel has to be in native mode, otherwise the shifter does not report.
+ *
+ * duration_sec = 0 runs until interrupted.
+ */
+int run_shifter(wheelstruct *w, char *device_file_name, const char *shm_name, int debounce_ms, int duration_sec);
+
+#endif
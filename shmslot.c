@@ -0,0 +1,102 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmslot.h"
+
+
+void *shm_slot_open(const char *name, size_t size, int create)
+{
+    int fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+    if (fd == -1) {
+        perror(name);
+        return 0;
+    }
+    if (create && ftruncate(fd, size) != 0) {
+        perror("Resize shared memory");
+        close(fd);
+        return 0;
+    }
+    void *slot = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (slot == MAP_FAILED) {
+        perror("Map shared memory");
+        return 0;
+    }
+    return slot;
+}
+
+void *shm_slot_open_reader(const char *name, size_t size)
+{
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1)
+        return 0;
+    // writer may not have sized it yet
+    if (fstat(fd, &st) != 0 || st.st_size < size) {
+        close(fd);
+        return 0;
+    }
+    void *slot = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (slot == MAP_FAILED) {
+        perror("Map shared memory");
+        return 0;
+    }
+    return slot;
+}
+
+void shm_slot_close(void *slot, size_t size)
+{
+    munmap(slot, size);
+}
+
+void shm_slot_write_begin(unsigned int *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void shm_slot_write_end(unsigned int *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+int shm_slot_read(void *slot, void *dest, size_t size)
+{
+    unsigned int *seq = slot;
+    unsigned int start;
+    int tries = 0;
+    do {
+        while ((start = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+            if (++tries > SHM_SLOT_READ_TRIES)
+                return -1;
+        }
+        memcpy(dest, slot, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(seq, __ATOMIC_RELAXED) != start && ++tries <= SHM_SLOT_READ_TRIES);
+    return tries > SHM_SLOT_READ_TRIES ? -1 : 0;
+}
@@ -0,0 +1,63 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef shmslot_h
+#define shmslot_h
+
+#include <stddef.h>
+
+#define SHM_SLOT_READ_TRIES 100000       /* an update takes a few stores, a writer stuck longer has died */
+
+/*
+ * Shared memory slots are small structs in POSIX shared memory (/dev/shm) with a
+ * single writer and any number of readers.
+ *
+ * Every slot starts with a sequence counter. The writer increments it before and
+ * after updating the slot (so it is odd while an update is in progress), readers
+ * retry until they read the same even counter before and after copying the slot.
+ * Neither side ever blocks: readers give up if the writer died within an update.
+ */
+
+/*
+ * Map slot with given name (e.g. "/ltwheelconf-gear"). If create is set the slot
+ * is created if necessary, otherwise it has to exist already.
+ * Returns 0 on failure.
+ */
+void *shm_slot_open(const char *name, size_t size, int create);
+
+/*
+ * Map slot with given name read-only, for readers of a slot created by its writer
+ * (works whoever owns the slot, e.g. an unprivileged game).
+ * Returns 0 if the slot does not exist (yet) or is too small.
+ */
+void *shm_slot_open_reader(const char *name, size_t size);
+void shm_slot_close(void *slot, size_t size);
+
+void shm_slot_write_begin(unsigned int *seq);
+void shm_slot_write_end(unsigned int *seq);
+
+/*
+ * Copy slot consistently into dest.
+ * Returns 0 on success, -1 if no consistent copy could be made within
+ * SHM_SLOT_READ_TRIES tries (writer died within an update), dest is undefined then.
+ */
+int shm_slot_read(void *slot, void *dest, size_t size);
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include <linux/input.h>
+
+#include "wheels.h"
+#include "wheelfunctions.h"
+#include "stats.h"
+#include "inventory.h"
+#include "calibration.h"
+#include "snapshot.h"
+
+/* Globals */
+extern int verbose_flag;
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Look up wheel w in the inventory, prefers a wheel in native mode.
+ * Returns 0 if found.
+ */
+static int find_wheel_info(wheelstruct *w, wheelinfo *info)
+{
+    wheelinfo list[MAX_INVENTORY];
+    int num = find_wheels(list, MAX_INVENTORY);
+    int i, found = -1;
+
+    for (i = 0; i < num; i++) {
+        if (list[i].pid == w->native_pid) {
+            found = i;
+            break;
+        }
+        if (list[i].pid == w->restricted_pid && found < 0)
+            found = i;
+    }
+    if (found < 0)
+        return -1;
+    *info = list[found];
+    return 0;
+}
+
+int write_snapshot(char *file_name, snapshot *snap)
+{
+    int i;
+    FILE *f = fopen(file_name, "w");
+    if (!f) {
+        perror(file_name);
+        return -1;
+    }
+    fprintf(f, "# ltwheelconf snapshot\n");
+    fprintf(f, "wheel %s\n", snap->shortname);
+    if (snap->native >= 0)
+        fprintf(f, "native %d\n", snap->native);
+    if (snap->range >= 0)
+        fprintf(f, "range %d\n", snap->range);
+    if (snap->centerforce >= 0)
+        fprintf(f, "autocenter %d %d\n", snap->centerforce, snap->rampspeed);
+    if (snap->gain >= 0)
+        fprintf(f, "gain %d\n", snap->gain);
+    if (snap->altautocenter >= 0)
+        fprintf(f, "altautocenter %d\n", snap->altautocenter);
+    for (i = 0; i < snap->cal.numAxes; i++) {
+        struct input_absinfo *ai = &snap->cal.absinfo[i];
+        fprintf(f, "axis %d %d %d %d %d\n", snap->cal.codes[i], ai->minimum, ai->maximum, ai->fuzz, ai->flat);
+    }
+    if (fclose(f) != 0) {
+        perror(file_name);
+        return -1;
+    }
+    return 0;
+}
+
+int read_snapshot(char *file_name, snapshot *snap)
+{
+    char line[256];
+    FILE *f = fopen(file_name, "r");
+    if (!f) {
+        perror(file_name);
+        return -1;
+    }
+    memset(snap, 0, sizeof(*snap));
+    snap->native = snap->range = snap->centerforce = snap->rampspeed = snap->gain = snap->altautocenter = -1;
+
+    while (fgets(line, sizeof(line), f)) {
+        int code, force, ramp;
+        struct input_absinfo ai;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        int fields = sscanf(line, "autocenter %d %d", &force, &ramp);
+        if (fields >= 1) {
+            // without rampspeed it stays missing, restore skips autocenter then
+            snap->centerforce = force;
+            snap->rampspeed = fields == 2 ? ramp : -1;
+            continue;
+        }
+        if (sscanf(line, "wheel %15s", snap->shortname) == 1
+            || sscanf(line, "native %d", &snap->native) == 1
+            || sscanf(line, "range %d", &snap->range) == 1
+            || sscanf(line, "gain %d", &snap->gain) == 1
+            || sscanf(line, "altautocenter %d", &snap->altautocenter) == 1)
+            continue;
+        memset(&ai, 0, sizeof(ai));
+        if (sscanf(line, "axis %d %d %d %d %d", &code, &ai.minimum, &ai.maximum, &ai.fuzz, &ai.flat) == 5
+            && code >= 0 && code < ABS_CNT && snap->cal.numAxes < ABS_CNT) {
+            snap->cal.codes[snap->cal.numAxes] = code;
+            snap->cal.absinfo[snap->cal.numAxes++] = ai;
+            continue;
+        }
+        printf("%s: ignoring unknown line: %s", file_name, line);
+    }
+    fclose(f);
+    if (!snap->shortname[0]) {
+        printf("%s: no wheel given.\n", file_name);
+        return -1;
+    }
+    return 0;
+}
+
+int take_snapshot(wheelstruct *w, char *device_file_name, char *file_name, int range, int centerforce,
+                  int rampspeed, int gain, int altautocenter)
+{
+    snapshot snap;
+    wheelinfo info;
+    char evdev[128];
+
+    if (centerforce > 0 && rampspeed < 0) {
+        printf("Please provide '--rampspeed' parameter\n");
+        return -1;
+    }
+    memset(&snap, 0, sizeof(snap));
+    snprintf(snap.shortname, sizeof(snap.shortname), "%.15s", w->shortname);
+    snap.native = -1;
+    snap.range = range;
+    snap.centerforce = centerforce;
+    snap.rampspeed = centerforce > 0 ? rampspeed : 0;
+    snap.gain = gain;
+    snap.altautocenter = altautocenter;
+
+    snprintf(evdev, sizeof(evdev), "%s", device_file_name);
+    if (find_wheel_info(w, &info) == 0) {
+        snap.native = info.pid == w->native_pid;
+        if (info.range > 0)
+            snap.range = info.range;
+        if (!evdev[0])
+            snprintf(evdev, sizeof(evdev), "%s", info.evdev);
+    } else {
+        printf("%s not found, only storing given settings.\n", w->name);
+    }
+
+    if (evdev[0]) {
+        int fd = open(evdev, O_RDONLY);
+        if (fd == -1) {
+            perror(evdev);
+        } else {
+            if (read_calibration(fd, &snap.cal) != 0)
+                snap.cal.numAxes = 0;
+            close(fd);
+        }
+    }
+
+    if (write_snapshot(file_name, &snap) != 0)
+        return -1;
+    printf("Snapshot of %s written to %s (", w->name, file_name);
+    printf("mode %s", snap.native < 0 ? "unknown" : snap.native ? "native" : "restricted");
+    if (snap.range >= 0) printf(", range %d", snap.range);
+    if (snap.centerforce >= 0) printf(", autocenter %d/%d", snap.centerforce, snap.rampspeed);
+    if (snap.gain >= 0) printf(", gain %d", snap.gain);
+    if (snap.altautocenter >= 0) printf(", altautocenter %d", snap.altautocenter);
+    printf(", %d axes).\n", snap.cal.numAxes);
+    return 0;
+}
+
+static int write_ff(int fd, int code, int percent)
+{
+    static int writes = -1;
+    if (writes < 0)
+        writes = evdev_write_stats("restore");
+    struct input_event ie;
+    memset(&ie, 0, sizeof(ie));
+    ie.type = EV_FF;
+    ie.code = code;
+    ie.value = 0xFFFFUL * percent / 100;
+    long long start = now_ns();
+    int stat = write(fd, &ie, sizeof(ie));
+    stats_observe_ns(writes, now_ns() - start);
+    if (stat == -1) {
+        perror(code == FF_GAIN ? "set gain" : "set auto-center");
+        return -1;
+    }
+    return 0;
+}
+
+int restore_snapshot(char *file_name, char *device_file_name)
+{
+    snapshot snap;
+    wheelstruct *w = 0;
+    wheelinfo info;
+    cmdstruct cmds[2];
+    int numCmds = 0;
+    int failed = 0;
+    int rebound = 0;
+    int i;
+
+    if (read_snapshot(file_name, &snap) != 0)
+        return -1;
+    w = find_wheel(snap.shortname);
+    if (!w) {
+        printf("Wheel \"%s\" of snapshot not supported.\n", snap.shortname);
+        return -1;
+    }
+
+    long long start = now_ns();
+
+    // 1. mode switch, the wheel re-enumerates
+    if (snap.native == 1 && w->native_pid != w->restricted_pid
+        && (find_wheel_info(w, &info) != 0 || info.pid != w->native_pid)) {
+        if (set_native_mode(w) != 0)
+            return -1;
+        rebound = 1;
+    }
+    long long mode_done = now_ns();
+
+    // 2. all USB commands in one session
+    memset(cmds, 0, sizeof(cmds));
+    if (snap.range >= 0 && w->get_range_cmd)
+        w->get_range_cmd(&cmds[numCmds++], clamprange(w, snap.range));
+    if (snap.centerforce > 0 && snap.rampspeed < 0) {
+        // written without rampspeed, do not let the command encoding turn it into the maximum
+        printf("Snapshot has no rampspeed for autocenter, skipping autocenter.\n");
+    } else if (snap.centerforce >= 0 && w->get_autocenter_cmd) {
+        w->get_autocenter_cmd(&cmds[numCmds++], snap.centerforce, snap.centerforce ? snap.rampspeed : 0);
+    }
+    if (numCmds) {
+        int hidfd = open_wheel_hidraw(w);
+        if (hidfd != -1) {
+            for (i = 0; i < numCmds; i++)
+                failed |= send_command_hidraw(hidfd, cmds[i]) != 0;
+            close(hidfd);
+        } else {
+            libusb_device_handle *handle = libusb_open_device_with_vid_pid(NULL, VID_LOGITECH, w->native_pid);
+            if (!handle) {
+                printf("%s not found. Make sure it is set to native mode (use --native).\n", w->name);
+                return -1;
+            }
+            if (claim_wheel(handle) < 0) {
+                libusb_close(handle);
+                return -1;
+            }
+            for (i = 0; i < numCmds; i++)
+                failed |= send_command_claimed(handle, cmds[i]) < 0;
+            release_wheel(handle);
+            libusb_close(handle);
+            rebound = 1;
+        }
+    }
+    long long usb_done = now_ns();
+
+    // 3. one event device session, once udev recreated the node
+    long long udev_done = usb_done;
+    int numAxes = 0;
+    if (snap.gain >= 0 || snap.altautocenter >= 0 || snap.cal.numAxes) {
+        char evdev[128];
+        if (rebound) {
+            wait_udev();
+            udev_done = now_ns();
+        }
+        snprintf(evdev, sizeof(evdev), "%s", device_file_name);
+        if (!evdev[0] && find_wheel_info(w, &info) == 0)
+            snprintf(evdev, sizeof(evdev), "%s", info.evdev);
+        int fd = evdev[0] ? open(evdev, O_RDWR) : -1;
+        if (fd == -1) {
+            printf("No event device for %s, skipping gain, autocenter force and axis limits.\n", w->name);
+            failed = 1;
+        } else {
+            if (snap.gain >= 0)
+                failed |= write_ff(fd, FF_GAIN, snap.gain) != 0;
+            if (snap.altautocenter >= 0)
+                failed |= write_ff(fd, FF_AUTOCENTER, snap.altautocenter) != 0;
+            if (snap.cal.numAxes) {
+                failed |= write_calibration(fd, &snap.cal) != 0;
+                numAxes = snap.cal.numAxes;
+            }
+            close(fd);
+        }
+    }
+    long long end = now_ns();
+
+    printf("Restored %s from %s%s: %d USB commands, %d axes.\n", w->name, file_name, failed ? " with errors" : "",
+           numCmds, numAxes);
+    printf("Mode %.1f ms, USB commands %.1f ms, udev wait %.1f ms, event device %.1f ms, total %.1f ms\n",
+           (mode_done - start) / 1e6, (usb_done - mode_done) / 1e6, (udev_done - usb_done) / 1e6,
+           (end - udev_done) / 1e6, (end - start) / 1e6);
+    return failed ? -1 : 0;
+}
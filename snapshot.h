@@ -0,0 +1,61 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef snapshot_h
+#define snapshot_h
+
+#include "wheels.h"
+#include "calibration.h"
+
+typedef struct {
+    char shortname[16];
+    int native;                          /* 1 native, 0 restricted, -1 unknown */
+    int range;                           /* degrees, -1 if not captured */
+    int centerforce;                     /* -1 if not captured */
+    int rampspeed;
+    int gain;                            /* 0..100, -1 if not captured */
+    int altautocenter;                   /* 0..100, -1 if not captured */
+    calibration cal;                     /* numAxes is 0 if not captured */
+} snapshot;
+
+/*
+ * Capture configuration of wheel w to file: mode, range (as reported by hid-lg4ff)
+ * and the axis limits of the event device are read from the wheel, the settings
+ * the wheel can not report (autocenter, rampspeed, gain) are taken from the
+ * given values (-1 to leave out).
+ * device_file_name may be empty, then the event device is looked up.
+ */
+int take_snapshot(wheelstruct *w, char *device_file_name, char *file_name, int range, int centerforce,
+                  int rampspeed, int gain, int altautocenter);
+
+/*
+ * Restore snapshot as one batch:
+ *  1. switch to native mode, if needed
+ *  2. range and autocenter in a single command session (through hidraw if the
+ *     wheel has a node, so the kernel driver stays bound, otherwise one claim session)
+ *  3. gain, autocenter force and axis limits in a single event device session
+ * Time of every step is reported.
+ */
+int restore_snapshot(char *file_name, char *device_file_name);
+
+int read_snapshot(char *file_name, snapshot *snap);
+int write_snapshot(char *file_name, snapshot *snap);
+
+#endif
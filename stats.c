@@ -0,0 +1,267 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "stats.h"
+
+/* Globals */
+extern int verbose_flag;
+
+#define STATS_COUNTER 0
+#define STATS_HISTOGRAM 1
+
+typedef struct {
+    char name[64];
+    char labels[96];
+    const char *help;
+    int type;
+    int first;                           /* index of first value in the rows */
+} statsmetric;
+
+static statsmetric metrics[STATS_MAX_METRICS];
+static int numMetrics = 0;
+static int numValues = 0;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * One row per thread, each row is only written by its thread. The last row is
+ * shared by all threads exceeding STATS_MAX_THREADS and updated atomically.
+ */
+static unsigned long long rows[STATS_MAX_THREADS][STATS_MAX_VALUES] __attribute__((aligned(64)));
+static int numRows = 0;
+static __thread int thread_row = -1;
+
+static char *export_file = 0;
+static pthread_t exporter;
+static int exporting = 0;
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t export_cond = PTHREAD_COND_INITIALIZER;
+
+static int register_metric(const char *name, const char *labels, const char *help, int type, int size)
+{
+    int i, id = -1;
+    if (!labels)
+        labels = "";
+
+    pthread_mutex_lock(&registry_lock);
+    for (i = 0; i < numMetrics; i++) {
+        if (strcmp(metrics[i].name, name) == 0 && strcmp(metrics[i].labels, labels) == 0) {
+            id = i;
+            break;
+        }
+    }
+    if (id < 0 && numMetrics < STATS_MAX_METRICS && numValues + size <= STATS_MAX_VALUES) {
+        id = numMetrics++;
+        snprintf(metrics[id].name, sizeof(metrics[id].name), "%s", name);
+        snprintf(metrics[id].labels, sizeof(metrics[id].labels), "%s", labels);
+        metrics[id].help = help;
+        metrics[id].type = type;
+        metrics[id].first = numValues;
+        numValues += size;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return id;
+}
+
+int stats_counter(const char *name, const char *labels, const char *help)
+{
+    return register_metric(name, labels, help, STATS_COUNTER, 1);
+}
+
+int stats_histogram(const char *name, const char *labels, const char *help)
+{
+    return register_metric(name, labels, help, STATS_HISTOGRAM, STATS_HIST_VALUES);
+}
+
+static inline void add_value(int index, unsigned long long n)
+{
+    if (thread_row < 0) {
+        thread_row = __atomic_fetch_add(&numRows, 1, __ATOMIC_RELAXED);
+        if (thread_row >= STATS_MAX_THREADS)
+            thread_row = STATS_MAX_THREADS - 1;
+    }
+    unsigned long long *v = &rows[thread_row][index];
+    if (thread_row == STATS_MAX_THREADS - 1)
+        __atomic_fetch_add(v, n, __ATOMIC_RELAXED);
+    else
+        __atomic_store_n(v, *v + n, __ATOMIC_RELAXED);
+}
+
+void stats_add(int id, unsigned long long n)
+{
+    if (id < 0)
+        return;
+    add_value(metrics[id].first, n);
+}
+
+void stats_observe_ns(int id, long long ns)
+{
+    if (id < 0)
+        return;
+    unsigned long long us = ns > 0 ? (ns + 999) / 1000 : 0;
+    int bucket = us > 1 ? 64 - __builtin_clzll(us - 1) : 0;
+    if (bucket > STATS_BUCKETS - 1)
+        bucket = STATS_BUCKETS - 1;
+    add_value(metrics[id].first + bucket, 1);
+    add_value(metrics[id].first + STATS_BUCKETS, ns > 0 ? ns : 0);
+    add_value(metrics[id].first + STATS_BUCKETS + 1, 1);
+}
+
+static unsigned long long sum_value(int index)
+{
+    unsigned long long sum = 0;
+    int r;
+    for (r = 0; r < STATS_MAX_THREADS; r++)
+        sum += __atomic_load_n(&rows[r][index], __ATOMIC_RELAXED);
+    return sum;
+}
+
+static void print_series(FILE *f, const char *name, const char *suffix, const char *labels, const char *extra,
+                         unsigned long long value)
+{
+    const char *sep = (labels[0] && extra[0]) ? "," : "";
+    if (labels[0] || extra[0])
+        fprintf(f, "%s%s{%s%s%s} %llu\n", name, suffix, labels, sep, extra, value);
+    else
+        fprintf(f, "%s%s %llu\n", name, suffix, value);
+}
+
+static void write_metrics(FILE *f)
+{
+    static statsmetric copy[STATS_MAX_METRICS];    /* exports never run concurrently */
+    int i, j, b;
+
+    // registered metrics never change, so only the list is copied under the lock
+    pthread_mutex_lock(&registry_lock);
+    int n = numMetrics;
+    memcpy(copy, metrics, n * sizeof(statsmetric));
+    pthread_mutex_unlock(&registry_lock);
+
+    for (i = 0; i < n; i++) {
+        // metrics of the same name are grouped below the first one
+        for (j = 0; j < i; j++) {
+            if (strcmp(copy[j].name, copy[i].name) == 0)
+                break;
+        }
+        if (j < i)
+            continue;
+        if (copy[i].help)
+            fprintf(f, "# HELP %s %s\n", copy[i].name, copy[i].help);
+        fprintf(f, "# TYPE %s %s\n", copy[i].name, copy[i].type == STATS_COUNTER ? "counter" : "histogram");
+
+        for (j = i; j < n; j++) {
+            statsmetric *m = &copy[j];
+            if (strcmp(m->name, copy[i].name) != 0)
+                continue;
+            if (m->type == STATS_COUNTER) {
+                print_series(f, m->name, "", m->labels, "", sum_value(m->first));
+                continue;
+            }
+            unsigned long long cumulative = 0;
+            for (b = 0; b < STATS_BUCKETS; b++) {
+                char le[32];
+                cumulative += sum_value(m->first + b);
+                if (b == STATS_BUCKETS - 1)
+                    snprintf(le, sizeof(le), "le=\"+Inf\"");
+                else
+                    snprintf(le, sizeof(le), "le=\"%g\"", (double)(1ULL << b) / 1e6);
+                print_series(f, m->name, "_bucket", m->labels, le, cumulative);
+            }
+            double sum = sum_value(m->first + STATS_BUCKETS) / 1e9;
+            if (m->labels[0])
+                fprintf(f, "%s_sum{%s} %.9f\n", m->name, m->labels, sum);
+            else
+                fprintf(f, "%s_sum %.9f\n", m->name, sum);
+            print_series(f, m->name, "_count", m->labels, "", sum_value(m->first + STATS_BUCKETS + 1));
+        }
+    }
+}
+
+static int export_metrics()
+{
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%.500s.tmp", export_file);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        perror("Write statistics");
+        return -1;
+    }
+    write_metrics(f);
+    if (fclose(f) != 0 || rename(tmp, export_file) != 0) {
+        perror("Write statistics");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static void *stats_exporter(void *arg)
+{
+    struct timespec ts;
+
+    pthread_mutex_lock(&export_lock);
+    while (exporting) {
+        pthread_mutex_unlock(&export_lock);
+        export_metrics();
+        pthread_mutex_lock(&export_lock);
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += STATS_INTERVAL_SEC;
+        if (exporting)
+            pthread_cond_timedwait(&export_cond, &export_lock, &ts);
+    }
+    pthread_mutex_unlock(&export_lock);
+    return 0;
+}
+
+int stats_start(const char *file_name)
+{
+    if (exporting)
+        return 0;
+    export_file = strdup(file_name);
+    exporting = 1;
+    if (pthread_create(&exporter, NULL, stats_exporter, NULL) != 0) {
+        perror("Start statistics");
+        exporting = 0;
+        return -1;
+    }
+    if (verbose_flag) printf("Writing statistics to %s every %d s\n", file_name, STATS_INTERVAL_SEC);
+    return 0;
+}
+
+void stats_stop()
+{
+    if (!exporting)
+        return;
+    pthread_mutex_lock(&export_lock);
+    exporting = 0;
+    pthread_cond_signal(&export_cond);
+    pthread_mutex_unlock(&export_lock);
+    pthread_join(exporter, NULL);
+    export_metrics();
+    free(export_file);
+    export_file = 0;
+}
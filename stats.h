@@ -0,0 +1,59 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef stats_h
+#define stats_h
+
+#define STATS_MAX_THREADS 16
+#define STATS_MAX_VALUES 1024            /* per thread, a counter takes 1, a histogram STATS_HIST_VALUES */
+#define STATS_MAX_METRICS 128
+#define STATS_BUCKETS 22                 /* log2 buckets: <= 1 us, 2 us, 4 us ... 2^20 us (~1 s), +Inf */
+#define STATS_HIST_VALUES (STATS_BUCKETS + 2)
+#define STATS_INTERVAL_SEC 1
+
+/*
+ * Runtime statistics
+ *
+ * Metrics are registered by name and labels (e.g. "port=\"3-1.2\""), registering
+ * again returns the same id, so hot paths can keep the id in a static variable.
+ * Every thread counts into its own row, updates are plain stores without locks
+ * or atomic read-modify-write. Rows are summed up when the statistics are exported.
+ *
+ * Returns id of the metric, -1 if the registry is full.
+ */
+int stats_counter(const char *name, const char *labels, const char *help);
+int stats_histogram(const char *name, const char *labels, const char *help);
+
+void stats_add(int id, unsigned long long n);
+void stats_observe_ns(int id, long long ns);
+
+/*
+ * Write all metrics in Prometheus text format to file name every STATS_INTERVAL_SEC
+ * (written to a temporary file and renamed, so readers never see partial content;
+ * suitable for the textfile collector of the node exporter).
+ */
+int stats_start(const char *file_name);
+
+/*
+ * Write metrics a last time and stop exporting
+ */
+void stats_stop();
+
+#endif
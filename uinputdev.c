@@ -0,0 +1,150 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "uinputdev.h"
+
+/* Globals */
+extern int verbose_flag;
+
+
+int read_devcaps(int fd, devcaps *caps)
+{
+    int code;
+
+    memset(caps, 0, sizeof(*caps));
+    if (ioctl(fd, EVIOCGNAME(sizeof(caps->name) - 1), caps->name) < 0 || ioctl(fd, EVIOCGID, &caps->id) < 0) {
+        perror("Get device name and id");
+        return -1;
+    }
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(caps->evbits)), caps->evbits) < 0) {
+        perror("Get event types");
+        return -1;
+    }
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(caps->keybits)), caps->keybits);
+    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(caps->absbits)), caps->absbits);
+    ioctl(fd, EVIOCGBIT(EV_REL, sizeof(caps->relbits)), caps->relbits);
+    ioctl(fd, EVIOCGBIT(EV_MSC, sizeof(caps->mscbits)), caps->mscbits);
+    ioctl(fd, EVIOCGBIT(EV_FF, sizeof(caps->ffbits)), caps->ffbits);
+    for (code = 0; code < ABS_CNT; code++) {
+        if (caps_test_bit(code, caps->absbits))
+            ioctl(fd, EVIOCGABS(code), &caps->absinfo[code]);
+    }
+    if (caps_test_bit(EV_FF, caps->evbits)) {
+        int effects = 0;
+        if (ioctl(fd, EVIOCGEFFECTS, &effects) == 0)
+            caps->ff_effects_max = effects;
+    }
+    return 0;
+}
+
+static int enable_bits(int fd, int request, unsigned char *bits, int count)
+{
+    int code;
+    for (code = 0; code < count; code++) {
+        if (caps_test_bit(code, bits) && ioctl(fd, request, code) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int create_uinput(devcaps *caps)
+{
+    struct uinput_user_dev dev;
+    int code;
+
+    int fd = open(UINPUT_DEVICE, O_RDWR | O_NONBLOCK);
+    if (fd == -1) {
+        perror("Open " UINPUT_DEVICE);
+        return -1;
+    }
+
+    memset(&dev, 0, sizeof(dev));
+    strncpy(dev.name, caps->name, UINPUT_MAX_NAME_SIZE - 1);
+    dev.id = caps->id;
+    dev.ff_effects_max = caps->ff_effects_max;
+    for (code = 0; code < ABS_CNT; code++) {
+        dev.absmin[code] = caps->absinfo[code].minimum;
+        dev.absmax[code] = caps->absinfo[code].maximum;
+        dev.absfuzz[code] = caps->absinfo[code].fuzz;
+        dev.absflat[code] = caps->absinfo[code].flat;
+    }
+
+    if (enable_bits(fd, UI_SET_EVBIT, caps->evbits, EV_CNT) != 0
+        || enable_bits(fd, UI_SET_KEYBIT, caps->keybits, KEY_CNT) != 0
+        || enable_bits(fd, UI_SET_ABSBIT, caps->absbits, ABS_CNT) != 0
+        || enable_bits(fd, UI_SET_RELBIT, caps->relbits, REL_CNT) != 0
+        || enable_bits(fd, UI_SET_MSCBIT, caps->mscbits, MSC_CNT) != 0
+        || enable_bits(fd, UI_SET_FFBIT, caps->ffbits, FF_CNT) != 0) {
+        perror("Set uinput capabilities");
+        close(fd);
+        return -1;
+    }
+    if (write(fd, &dev, sizeof(dev)) != sizeof(dev) || ioctl(fd, UI_DEV_CREATE) < 0) {
+        perror("Create uinput device");
+        close(fd);
+        return -1;
+    }
+    if (verbose_flag) {
+        char sysname[64];
+        if (ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) >= 0)
+            printf("Created uinput device \"%s\" (%s).\n", dev.name, sysname);
+    }
+    return fd;
+}
+
+int uinput_event_node(int fd, char *path, size_t len)
+{
+    char sysname[64], dir[128];
+    int tries;
+
+    path[0] = 0;
+    if (ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0)
+        return -1;
+    snprintf(dir, sizeof(dir), "/sys/devices/virtual/input/%.48s", sysname);
+    for (tries = 0; tries < 100 && !path[0]; tries++) {
+        DIR *d = opendir(dir);
+        struct dirent *entry;
+        while (d && (entry = readdir(d))) {
+            if (strncmp(entry->d_name, "event", 5) == 0) {
+                snprintf(path, len, "/dev/input/%.48s", entry->d_name);
+                break;
+            }
+        }
+        if (d) closedir(d);
+        if (!path[0]) usleep(10000);
+    }
+    return path[0] ? 0 : -1;
+}
+
+void destroy_uinput(int fd)
+{
+    ioctl(fd, UI_DEV_DESTROY);
+    close(fd);
+}
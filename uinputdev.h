@@ -0,0 +1,71 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef uinputdev_h
+#define uinputdev_h
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#define UINPUT_DEVICE "/dev/uinput"
+
+/*
+ * Capabilities of an input device, enough to create a clone of it using uinput
+ */
+typedef struct {
+    char name[UINPUT_MAX_NAME_SIZE];
+    struct input_id id;
+    unsigned char evbits[EV_CNT / 8 + 1];
+    unsigned char keybits[KEY_CNT / 8 + 1];
+    unsigned char absbits[ABS_CNT / 8 + 1];
+    unsigned char relbits[REL_CNT / 8 + 1];
+    unsigned char mscbits[MSC_CNT / 8 + 1];
+    unsigned char ffbits[FF_CNT / 8 + 1];
+    struct input_absinfo absinfo[ABS_CNT];
+    unsigned int ff_effects_max;
+} devcaps;
+
+#define caps_test_bit(bit, array) ((array)[(bit) / 8] & (1 << ((bit) % 8)))
+#define caps_set_bit(bit, array) ((array)[(bit) / 8] |= (1 << ((bit) % 8)))
+
+/*
+ * Read capabilities of an open event device
+ */
+int read_devcaps(int fd, devcaps *caps);
+
+/*
+ * Create uinput device with given capabilities.
+ * Returns file descriptor of the uinput device, -1 on failure.
+ */
+int create_uinput(devcaps *caps);
+
+/*
+ * Find event device of a created uinput device (e.g. "/dev/input/event12"),
+ * waits up to a second for it to show up.
+ * Returns 0 on success, -1 if not found.
+ */
+int uinput_event_node(int fd, char *path, size_t len);
+
+/*
+ * Remove uinput device again
+ */
+void destroy_uinput(int fd);
+
+#endif
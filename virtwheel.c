@@ -0,0 +1,326 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "wheels.h"
+#include "uinputdev.h"
+#include "virtwheel.h"
+
+/* Globals */
+extern int verbose_flag;
+
+typedef struct {
+    int used;
+    struct ff_effect effect;
+    int playing;
+    long long end_ns;                    /* 0 plays until stopped */
+} vweffect;
+
+typedef struct {
+    int fd;
+    vweffect effects[VW_MAX_EFFECTS];
+    int gain;                            /* 0..0xffff */
+    int autocenter;                      /* 0..0xffff */
+    double angle;                        /* degrees, 0 is center */
+    double velocity;                     /* degrees/s */
+    unsigned long long uploads, erases, plays, settings;
+} vwheel;
+
+static volatile sig_atomic_t stop_wheel = 0;
+
+static void handle_stop(int sig)
+{
+    stop_wheel = 1;
+}
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Capabilities of wheel w in native mode as set up by hid-lg and hid-lg4ff
+ */
+static void wheel_caps(wheelstruct *w, devcaps *caps)
+{
+    int i, extraButtons = 0;
+
+    memset(caps, 0, sizeof(*caps));
+    if (strcasecmp(w->shortname, "G25") == 0 || strcasecmp(w->shortname, "G27") == 0)
+        snprintf(caps->name, sizeof(caps->name), "%.64s Racing Wheel", w->name);
+    else
+        snprintf(caps->name, sizeof(caps->name), "%.79s", w->name);
+    caps->id.bustype = BUS_USB;
+    caps->id.vendor = VID_LOGITECH;
+    caps->id.product = w->native_pid;
+    caps->id.version = 0x0111;
+
+    caps_set_bit(EV_SYN, caps->evbits);
+    caps_set_bit(EV_KEY, caps->evbits);
+    caps_set_bit(EV_ABS, caps->evbits);
+    caps_set_bit(EV_FF, caps->evbits);
+
+    // first 16 buttons are joystick buttons, the rest "trigger happy" buttons
+    if (strcasecmp(w->shortname, "G27") == 0)
+        extraButtons = 6;
+    else if (strcasecmp(w->shortname, "G25") == 0)
+        extraButtons = 3;
+    for (i = 0; i < 16; i++)
+        caps_set_bit(BTN_JOYSTICK + i, caps->keybits);
+    for (i = 0; i < extraButtons; i++)
+        caps_set_bit(BTN_TRIGGER_HAPPY1 + i, caps->keybits);
+
+    caps_set_bit(ABS_X, caps->absbits);
+    caps->absinfo[ABS_X].maximum = 16383;
+    caps->absinfo[ABS_X].value = 8192;
+    // pedals report 255 when released
+    static const int pedals[] = { ABS_Y, ABS_Z, ABS_RZ };
+    for (i = 0; i < 3; i++) {
+        caps_set_bit(pedals[i], caps->absbits);
+        caps->absinfo[pedals[i]].maximum = 255;
+        caps->absinfo[pedals[i]].value = 255;
+    }
+    caps_set_bit(ABS_HAT0X, caps->absbits);
+    caps_set_bit(ABS_HAT0Y, caps->absbits);
+    caps->absinfo[ABS_HAT0X].minimum = caps->absinfo[ABS_HAT0Y].minimum = -1;
+    caps->absinfo[ABS_HAT0X].maximum = caps->absinfo[ABS_HAT0Y].maximum = 1;
+
+    caps_set_bit(FF_CONSTANT, caps->ffbits);
+    caps_set_bit(FF_GAIN, caps->ffbits);
+    caps_set_bit(FF_AUTOCENTER, caps->ffbits);
+    caps->ff_effects_max = VW_MAX_EFFECTS;
+}
+
+static void handle_upload(vwheel *v, int request_id)
+{
+    struct uinput_ff_upload up;
+    memset(&up, 0, sizeof(up));
+    up.request_id = request_id;
+    if (ioctl(v->fd, UI_BEGIN_FF_UPLOAD, &up) < 0) {
+        perror("Begin effect upload");
+        return;
+    }
+    if (up.effect.type != FF_CONSTANT || up.effect.id < 0 || up.effect.id >= VW_MAX_EFFECTS) {
+        up.retval = -EINVAL;
+    } else {
+        // updating a playing effect keeps it playing
+        vweffect *e = &v->effects[up.effect.id];
+        e->used = 1;
+        e->effect = up.effect;
+        up.retval = 0;
+        v->uploads++;
+    }
+    if (ioctl(v->fd, UI_END_FF_UPLOAD, &up) < 0)
+        perror("End effect upload");
+}
+
+static void handle_erase(vwheel *v, int request_id)
+{
+    struct uinput_ff_erase er;
+    memset(&er, 0, sizeof(er));
+    er.request_id = request_id;
+    if (ioctl(v->fd, UI_BEGIN_FF_ERASE, &er) < 0) {
+        perror("Begin effect erase");
+        return;
+    }
+    if (er.effect_id < VW_MAX_EFFECTS)
+        memset(&v->effects[er.effect_id], 0, sizeof(vweffect));
+    er.retval = 0;
+    v->erases++;
+    if (ioctl(v->fd, UI_END_FF_ERASE, &er) < 0)
+        perror("End effect erase");
+}
+
+static void handle_events(vwheel *v, long long now)
+{
+    struct input_event ev[64];
+    ssize_t len;
+    int i;
+
+    while ((len = read(v->fd, ev, sizeof(ev))) > 0) {
+        int numEvents = len / sizeof(struct input_event);
+        for (i = 0; i < numEvents; i++) {
+            if (ev[i].type == EV_UINPUT && ev[i].code == UI_FF_UPLOAD) {
+                handle_upload(v, ev[i].value);
+            } else if (ev[i].type == EV_UINPUT && ev[i].code == UI_FF_ERASE) {
+                handle_erase(v, ev[i].value);
+            } else if (ev[i].type == EV_FF && ev[i].code == FF_GAIN) {
+                v->gain = ev[i].value & 0xffff;
+                v->settings++;
+            } else if (ev[i].type == EV_FF && ev[i].code == FF_AUTOCENTER) {
+                v->autocenter = ev[i].value & 0xffff;
+                v->settings++;
+            } else if (ev[i].type == EV_FF && ev[i].code < VW_MAX_EFFECTS) {
+                // value is the number of repetitions, 0 stops
+                vweffect *e = &v->effects[ev[i].code];
+                if (!e->used)
+                    continue;
+                e->playing = ev[i].value > 0;
+                e->end_ns = 0;
+                if (e->playing && e->effect.replay.length)
+                    e->end_ns = now + (long long)ev[i].value * (e->effect.replay.delay + e->effect.replay.length) * 1000000LL;
+                v->plays++;
+            }
+        }
+    }
+    if (len < 0 && errno != EAGAIN)
+        perror("Read uinput device");
+}
+
+/*
+ * Advance motor model by dt seconds
+ */
+static void simulate(vwheel *v, long long now, double dt, double range)
+{
+    double force = 0;
+    int i;
+
+    for (i = 0; i < VW_MAX_EFFECTS; i++) {
+        vweffect *e = &v->effects[i];
+        if (!e->playing)
+            continue;
+        if (e->end_ns && now >= e->end_ns) {
+            e->playing = 0;
+            continue;
+        }
+        // as combined by ff-memless: level along the direction of the effect
+        force += e->effect.u.constant.level / 32767.0 * sin(e->effect.direction * 2 * M_PI / 0x10000);
+    }
+    if (force > 1) force = 1;
+    if (force < -1) force = -1;
+    force *= v->gain / 65535.0;
+
+    double accel = force * VW_MOTOR_ACCEL - VW_DAMPING * v->velocity - VW_SPRING * v->autocenter / 65535.0 * v->angle;
+    v->velocity += accel * dt;
+    v->angle += v->velocity * dt;
+    // end stops
+    if (v->angle > range / 2) {
+        v->angle = range / 2;
+        v->velocity = 0;
+    } else if (v->angle < -range / 2) {
+        v->angle = -range / 2;
+        v->velocity = 0;
+    }
+}
+
+static void emit(int fd, int type, int code, int value)
+{
+    struct input_event ie;
+    memset(&ie, 0, sizeof(ie));
+    ie.type = type;
+    ie.code = code;
+    ie.value = value;
+    if (write(fd, &ie, sizeof(ie)) == -1 && verbose_flag)
+        perror("Write uinput event");
+}
+
+int run_virtual_wheel(wheelstruct *w, int range, int duration_sec)
+{
+    devcaps caps;
+    vwheel *v;
+    char node[128];
+
+    if (range <= 0)
+        range = w->max_rotation;
+    wheel_caps(w, &caps);
+
+    v = calloc(1, sizeof(vwheel));
+    if (!v) {
+        perror("Allocate virtual wheel");
+        return -1;
+    }
+    v->fd = create_uinput(&caps);
+    if (v->fd == -1) {
+        free(v);
+        return -1;
+    }
+    v->gain = 0xffff;
+    uinput_event_node(v->fd, node, sizeof(node));
+    printf("Virtual %s (%d degrees) running at %d Hz on %s\n", w->name, range, VW_RATE_HZ,
+           node[0] ? node : "unknown event device");
+
+    stop_wheel = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    const long long tick_ns = 1000000000LL / VW_RATE_HZ;
+    int absmax = caps.absinfo[ABS_X].maximum;
+    int lastX = caps.absinfo[ABS_X].value;
+    unsigned long long ticks = 0, late = 0, reports = 0;
+    long long lateMax = 0;
+    long long start = now_ns();
+    long long deadline = duration_sec ? start + duration_sec * 1000000000LL : 0;
+    long long next = start;
+
+    while (!stop_wheel && (!deadline || next < deadline)) {
+        struct timespec ts;
+        next += tick_ns;
+        ts.tv_sec = next / 1000000000LL;
+        ts.tv_nsec = next % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !stop_wheel)
+            ;
+        long long now = now_ns();
+        if (now - next > tick_ns) {
+            late++;
+            if (now - next > lateMax)
+                lateMax = now - next;
+        }
+
+        // the model advances in fixed steps, so results do not depend on scheduling
+        handle_events(v, next);
+        simulate(v, next, tick_ns / 1e9, range);
+        ticks++;
+
+        int x = lround((v->angle / range + 0.5) * absmax);
+        if (x != lastX) {
+            emit(v->fd, EV_ABS, ABS_X, x);
+            emit(v->fd, EV_SYN, SYN_REPORT, 0);
+            lastX = x;
+            reports++;
+        }
+    }
+
+    double seconds = (now_ns() - start) / 1e9;
+    printf("Simulated %llu ticks in %.1f s, %llu late (max %lld us), %llu position reports.\n", ticks, seconds,
+           late, lateMax / 1000, reports);
+    printf("Effects uploaded %llu, erased %llu, played/stopped %llu, gain/autocenter changes %llu.\n", v->uploads,
+           v->erases, v->plays, v->settings);
+
+    destroy_uinput(v->fd);
+    free(v);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
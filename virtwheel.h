@@ -0,0 +1,51 @@
+/*
+ *    ltwheelconf - configure logitech racing wheels
+ *
+ *    Copyright (C) 2011  Michael Bauer <michael@m-bauer.org>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef virtwheel_h
+#define virtwheel_h
+
+#include "wheels.h"
+
+#define VW_RATE_HZ 1000
+#define VW_MAX_EFFECTS 16                /* like ff-memless, which hid-lg4ff uses */
+#define VW_MOTOR_ACCEL 10000.0           /* deg/s^2 at full constant force and gain */
+#define VW_DAMPING 8.0                   /* 1/s, friction of motor and gears */
+#define VW_SPRING 100.0                  /* 1/s^2 at full autocenter */
+
+/*
+ * Virtual wheel
+ *
+ * Creates a uinput device looking like wheel w in native mode (same name, ids,
+ * axes, buttons and force feedback capabilities as with hid-lg4ff) and simulates
+ * the wheel at VW_RATE_HZ: constant force effects (uploaded with EVIOCSFF and
+ * played), FF_GAIN and FF_AUTOCENTER drive a simple motor model whose position is
+ * reported as ABS_X. The simulation only depends on the events received, so runs
+ * are repeatable.
+ *
+ * The event device of the virtual wheel is printed, use it with '--device' for
+ * --gain, --altautocenter, --ffmixer, --ffbench, --record etc.
+ * Settings sent over USB (--range, --autocenter, --nativemode) can not be simulated.
+ *
+ * range: rotation range of ABS_X in degrees (0 uses the wheel's maximum)
+ * duration_sec = 0 runs until interrupted.
+ */
+int run_virtual_wheel(wheelstruct *w, int range, int duration_sec);
+
+#endif
@@ -19,18 +19,23 @@
  */
 
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <linux/input.h>
 
 #include "wheels.h"
 #include "wheelfunctions.h"
+#include "inventory.h"
+#include "ffmixer.h"
+#include "stats.h"
+#include "devlock.h"
 
 #define TRANSFER_WAIT_TIMEOUT_MS 5000
 #define CONFIGURE_WAIT_SEC 3
-#define UDEV_WAIT_SEC 2
 
 /* Globals */
 extern int verbose_flag;
@@ -40,6 +45,26 @@ void print_cmd(char *result, unsigned char cmd[8]) {
 }
 
 
+wheelstruct *find_wheel(const char *shortname)
+{
+    int i;
+    for (i = 0; i < sizeof(wheels) / sizeof(wheelstruct); i++) {
+        if (strcasecmp(wheels[i].shortname, shortname) == 0)
+            return (wheelstruct *)&wheels[i];
+    }
+    return 0;
+}
+
+wheelstruct *find_wheel_by_pid(unsigned int pid)
+{
+    int i;
+    for (i = 0; i < sizeof(wheels) / sizeof(wheelstruct); i++) {
+        if (wheels[i].native_pid == pid)
+            return (wheelstruct *)&wheels[i];
+    }
+    return 0;
+}
+
 void list_devices() {
     libusb_device_handle *handle = 0;
     libusb_device *dev = 0;
@@ -62,7 +87,7 @@ void list_devices() {
                 int ret = libusb_get_device_descriptor(dev, &desc);
                 if (ret == 0) {
                     numFound++;
-                    libusb_get_string_descriptor_ascii(handle, desc.iProduct, descString, 255);
+                    get_product_string(dev, handle, &desc, descString, 255);
                     printf("\t\tFound \"%s\", release number %x, %04x:%04x (bus %d, device %d)",
                            descString, desc.bcdDevice, desc.idVendor, desc.idProduct,
                            libusb_get_bus_number(dev), libusb_get_device_address(dev));
@@ -79,20 +104,162 @@ void list_devices() {
     printf("Found %d devices.\n", numFound);
 }
 
-int send_command(libusb_device_handle *handle, cmdstruct command ) {
-    if (command.numCmds == 0) {
-        printf( "send_command: Empty command provided! Not sending anything...\n");
-        return 0;
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define REBIND_DETACH 0
+#define REBIND_ATTACH 1
+#define WAIT_UDEV 0
+#define WAIT_NATIVE 1
+
+/*
+ * Metric ids are registered once and kept, registering takes the registry lock.
+ * Registering again (e.g. racing threads) returns the same id.
+ */
+static void count_rebind(int op)
+{
+    static int rebinds[2] = { -1, -1 };
+    if (rebinds[op] < 0)
+        rebinds[op] = stats_counter("ltwheelconf_driver_rebinds_total", op == REBIND_ATTACH ? "op=\"attach\"" : "op=\"detach\"",
+                                    "Kernel driver detached from or re-attached to a wheel");
+    stats_add(rebinds[op], 1);
+}
+
+static void wait_reenumeration(int reason, int sec)
+{
+    static int waits[2] = { -1, -1 };
+    if (waits[reason] < 0)
+        waits[reason] = stats_histogram("ltwheelconf_reenumeration_wait_seconds",
+                                        reason == WAIT_NATIVE ? "reason=\"native\"" : "reason=\"udev\"",
+                                        "Waits for the wheel or its device nodes to reappear");
+    long long start = now_ns();
+    sleep(sec);
+    stats_observe_ns(waits[reason], now_ns() - start);
+}
+
+void wait_udev()
+{
+    wait_reenumeration(WAIT_UDEV, UDEV_WAIT_SEC);
+}
+
+int evdev_write_stats(const char *mode)
+{
+    char labels[32];
+    snprintf(labels, sizeof(labels), "mode=\"%.16s\"", mode);
+    return stats_histogram("ltwheelconf_evdev_write_seconds", labels, "Time to write an event to an event device");
+}
+
+static void observe_config_write(long long ns)
+{
+    static int writes = -1;
+    if (writes < 0)
+        writes = evdev_write_stats("config");
+    stats_observe_ns(writes, ns);
+}
+
+#define MAX_PORT_STATS 8
+
+typedef struct {
+    char port[64];
+    int sent;
+    int failed;
+    int duration;
+} portstats;
+
+/*
+ * USB transfer metrics of the port, registered once per thread and port
+ * (thread local, so the lookup needs no lock)
+ */
+static portstats *usb_stats(const char *port)
+{
+    static __thread portstats ports[MAX_PORT_STATS];
+    static __thread int numPorts = 0;
+    char labels[96];
+    int i;
+
+    for (i = 0; i < numPorts; i++) {
+        if (strcmp(ports[i].port, port) == 0)
+            return &ports[i];
+    }
+    // table full: reuse the last entry
+    i = (numPorts < MAX_PORT_STATS) ? numPorts++ : MAX_PORT_STATS - 1;
+    snprintf(ports[i].port, sizeof(ports[i].port), "%s", port);
+    snprintf(labels, sizeof(labels), "port=\"%.64s\"", port);
+    ports[i].sent = stats_counter("ltwheelconf_usb_transfers_total", labels, "USB command transfers sent to a wheel");
+    ports[i].failed = stats_counter("ltwheelconf_usb_transfer_errors_total", labels, "USB command transfers that failed");
+    ports[i].duration = stats_histogram("ltwheelconf_usb_transfer_seconds", labels, "Duration of USB command transfers");
+    return &ports[i];
+}
+
+static void handle_port_path(libusb_device_handle *handle, char *port, size_t len)
+{
+    if (get_port_path(libusb_get_device(handle), port, len) != 0)
+        snprintf(port, len, "unknown");
+}
+
+/*
+ * Handles claimed while holding the device lock, release_wheel() only unlocks for these
+ */
+static libusb_device_handle *locked_handles[MAX_DEVICE_LOCKS];
+
+static void remember_locked(libusb_device_handle *handle)
+{
+    int i;
+    for (i = 0; i < MAX_DEVICE_LOCKS; i++) {
+        if (!locked_handles[i]) {
+            locked_handles[i] = handle;
+            return;
+        }
     }
+}
+
+static int forget_locked(libusb_device_handle *handle)
+{
+    int i;
+    for (i = 0; i < MAX_DEVICE_LOCKS; i++) {
+        if (locked_handles[i] == handle) {
+            locked_handles[i] = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
 
+int claim_wheel(libusb_device_handle *handle) {
     int stat;
+    char port[64];
+
+    handle_port_path(handle, port, sizeof(port));
+    int locked = lock_device(port) == 0;
+
     stat = libusb_detach_kernel_driver(handle, 0);
-    if ((stat < 0 ) || verbose_flag) perror("Detach kernel driver");
+    // not being attached is fine, e.g. if another claim session did not re-attach
+    if ((stat < 0 && stat != LIBUSB_ERROR_NOT_FOUND) || verbose_flag) perror("Detach kernel driver");
+    if (stat == 0) count_rebind(REBIND_DETACH);
 
     stat = libusb_claim_interface( handle, 0 );
     if ( (stat < 0) || verbose_flag) perror("Claiming USB interface");
+    if (stat < 0) {
+        libusb_attach_kernel_driver(handle, 0);
+        if (locked) unlock_device(port);
+    } else if (locked) {
+        remember_locked(handle);
+    }
+    return stat;
+}
 
+int send_command_claimed(libusb_device_handle *handle, cmdstruct command ) {
+    int stat;
+    int ret = 0;
     int transferred = 0;
+    char port[64];
+
+    handle_port_path(handle, port, sizeof(port));
+    portstats *ps = usb_stats(port);
 
     // send all command strings provided in command
     int cmdCount;
@@ -102,9 +269,24 @@ int send_command(libusb_device_handle *handle, cmdstruct command ) {
             print_cmd(raw_string, command.cmds[cmdCount]);
             printf("\tSending string:   \"%s\"\n", raw_string);
         }
+        long long start = now_ns();
         stat = libusb_interrupt_transfer( handle, 1, command.cmds[cmdCount], sizeof( command.cmds[cmdCount] ), &transferred, TRANSFER_WAIT_TIMEOUT_MS );
+        stats_observe_ns(ps->duration, now_ns() - start);
+        stats_add(ps->sent, 1);
         if ( (stat < 0) || verbose_flag) perror("Sending USB command");
+        if (stat < 0) {
+            stats_add(ps->failed, 1);
+            ret = stat;
+        }
     }
+    return ret;
+}
+
+void release_wheel(libusb_device_handle *handle) {
+    int stat;
+    char port[64];
+
+    handle_port_path(handle, port, sizeof(port));
 
     /* In case the command just sent caused the device to switch from restricted mode to native mode
      * the following two commands will fail due to invalid device handle (because the device changed
@@ -121,14 +303,112 @@ int send_command(libusb_device_handle *handle, cmdstruct command ) {
     }
 
     stat = libusb_attach_kernel_driver( handle, 0);
+    if (stat == 0) count_rebind(REBIND_ATTACH);
     if (stat != LIBUSB_ERROR_NO_DEVICE) { // silently ignore "No such device" error due to reasons explained above.
         if ( (stat < 0) || verbose_flag) {
             perror("Reattaching kernel driver");
         }
     }
+    if (forget_locked(handle))
+        unlock_device(port);
+}
+
+int open_wheel_hidraw(wheelstruct *w)
+{
+    wheelinfo list[MAX_INVENTORY];
+    int num = find_wheels(list, MAX_INVENTORY);
+    int i;
+
+    for (i = 0; i < num; i++) {
+        if (list[i].pid != w->native_pid || !list[i].hidraw[0])
+            continue;
+        int fd = open(list[i].hidraw, O_WRONLY);
+        if (fd != -1) {
+            if (verbose_flag) printf("Sending commands for %s to %s\n", w->name, list[i].hidraw);
+            return fd;
+        }
+        perror("Open hidraw device");
+    }
+    return -1;
+}
+
+int send_command_hidraw(int fd, cmdstruct command)
+{
+    int cmdCount;
+    for (cmdCount = 0; cmdCount < command.numCmds; cmdCount++) {
+        // no report ids, so the report is prefixed with report number 0
+        unsigned char report[sizeof(command.cmds[cmdCount])];
+        report[0] = 0;
+        memcpy(report + 1, command.cmds[cmdCount], sizeof(report) - 1);
+        if (verbose_flag) {
+            char raw_string[255];
+            print_cmd(raw_string, command.cmds[cmdCount]);
+            printf("\tWriting string:   \"%s\"\n", raw_string);
+        }
+        if (write(fd, report, sizeof(report)) != sizeof(report)) {
+            perror("Write hidraw command");
+            return -1;
+        }
+    }
     return 0;
 }
 
+int send_command(libusb_device_handle *handle, cmdstruct command ) {
+    if (command.numCmds == 0) {
+        printf( "send_command: Empty command provided! Not sending anything...\n");
+        return 0;
+    }
+
+    char port[64], name[64];
+    int status;
+    handle_port_path(handle, port, sizeof(port));
+
+    // leave the command in the spool, so whoever holds the wheel right now can send it along
+    int spooled = spool_request(port, &command, name, sizeof(name)) == 0;
+    int locked = lock_device(port) == 0;
+    if (spooled && spool_result(port, name, &status)) {
+        if (verbose_flag) printf("Command was sent by another ltwheelconf (status %d).\n", status);
+        if (locked) unlock_device(port);
+        return status;
+    }
+    // without the lock the spool can not be drained safely, just send our own command
+    if (spooled && !locked) {
+        spool_cancel(port, name);
+        spooled = 0;
+    }
+
+    status = claim_wheel(handle);
+    if (status < 0) {
+        if (spooled) spool_cancel(port, name);
+        if (locked) unlock_device(port);
+        return status;
+    }
+    if (!spooled) {
+        status = send_command_claimed(handle, command);
+    } else {
+        // send own and all other pending requests in this claim session, in order of arrival
+        char next[64];
+        cmdstruct c;
+        static int merged = -1;
+        if (merged < 0)
+            merged = stats_counter("ltwheelconf_merged_requests_total", 0,
+                                   "Commands of other processes sent in this process' claim session");
+        while (spool_next(port, next, sizeof(next), &c)) {
+            int result = send_command_claimed(handle, c);
+            if (strcmp(next, name) == 0) {
+                status = result;
+                spool_cancel(port, name);
+            } else {
+                spool_finish(port, next, result);
+                stats_add(merged, 1);
+            }
+        }
+    }
+    release_wheel(handle);
+    if (locked) unlock_device(port);
+    return status;
+}
+
 int set_native_mode(wheelstruct* w)
 {
     // first check if wheel has restriced/native mode at all
@@ -160,10 +440,11 @@ int set_native_mode(wheelstruct* w)
     cmdstruct c;
     memset(&c, 0, sizeof(c));
     w->get_nativemode_cmd(&c);
+    // the wheel leaves the bus while switching, so transfer errors are expected; success is checked below
     send_command(handle, c);
 
     // wait until wheel reconfigures to new PID...
-    sleep(CONFIGURE_WAIT_SEC);
+    wait_reenumeration(WAIT_NATIVE, CONFIGURE_WAIT_SEC);
 
     // If above command was successfully we should now find the wheel in extended mode
     handle = libusb_open_device_with_vid_pid(NULL, VID_LOGITECH, w->native_pid);
@@ -209,7 +490,10 @@ int set_range(wheelstruct* w, short unsigned int range)
     cmdstruct c;
     memset(&c, 0, sizeof(c));
     w->get_range_cmd(&c, range);
-    send_command(handle, c);
+    if (send_command(handle, c) < 0) {
+        printf ("Failed to set wheel rotation range of %s.\n", w->name);
+        return -1;
+    }
 
     printf ("Wheel rotation range of %s is now set to %d degrees.\n", w->name, range);
     return 0;
@@ -233,7 +517,10 @@ int set_autocenter(wheelstruct* w, int centerforce, int rampspeed)
     cmdstruct c;
     memset(&c, 0, sizeof(c));
     w->get_autocenter_cmd(&c, centerforce, rampspeed);
-    send_command(handle, c);
+    if (send_command(handle, c) < 0) {
+        printf ("Failed to set autocenter for %s.\n", w->name);
+        return -1;
+    }
 
     printf ("Autocenter for %s is now set to %d with rampspeed %d.\n", w->name, centerforce, rampspeed);
     return 0;
@@ -245,7 +532,14 @@ int alt_set_autocenter(int centerforce, char *device_file_name, int wait_for_ude
     /* sleep UDEV_WAIT_SEC seconds to allow udev to set up device nodes due to kernel
      * driver re-attaching while setting native mode or wheel range before
      */
-    if (wait_for_udev) sleep(UDEV_WAIT_SEC);
+    if (wait_for_udev) wait_udev();
+
+    /* If a force feedback mixer is running for this wheel let it combine our setting with the others */
+    if (centerforce >= 0 && centerforce <= 100
+        && ffmixer_configure(device_file_name, FFMIX_AUTOCENTER, 0xFFFFUL * centerforce/100) == 0) {
+        printf ("Wheel autocenter force is now set to %d (through force feedback mixer).\n", centerforce);
+        return 0;
+    }
 
     /* Open device */
     int fd = open(device_file_name, O_RDWR);
@@ -259,7 +553,10 @@ int alt_set_autocenter(int centerforce, char *device_file_name, int wait_for_ude
         ie.type = EV_FF;
         ie.code = FF_AUTOCENTER;
         ie.value = 0xFFFFUL * centerforce/100;
-        if (write(fd, &ie, sizeof(ie)) == -1) {
+        long long start = now_ns();
+        int stat = write(fd, &ie, sizeof(ie));
+        observe_config_write(now_ns() - start);
+        if (stat == -1) {
             perror("set auto-center");
             return -1;
         }
@@ -275,7 +572,13 @@ int set_gain(int gain, char *device_file_name, int wait_for_udev) {
     /* sleep UDEV_WAIT_SEC seconds to allow udev to set up device nodes due to kernel
      * driver re-attaching while setting native mode or wheel range before
      */
-    if (wait_for_udev) sleep(UDEV_WAIT_SEC);
+    if (wait_for_udev) wait_udev();
+
+    /* If a force feedback mixer is running for this wheel let it combine our setting with the others */
+    if (gain >= 0 && gain <= 100 && ffmixer_configure(device_file_name, FFMIX_GAIN, 0xFFFFUL * gain / 100) == 0) {
+        printf ("Wheel forcefeedback gain is now set to %d (through force feedback mixer).\n", gain);
+        return 0;
+    }
 
     /* Open device */
     int fd = open(device_file_name, O_RDWR);
@@ -289,7 +592,10 @@ int set_gain(int gain, char *device_file_name, int wait_for_udev) {
         ie.type = EV_FF;
         ie.code = FF_GAIN;
         ie.value = 0xFFFFUL * gain / 100;
-        if (write(fd, &ie, sizeof(ie)) == -1) {
+        long long start = now_ns();
+        int stat = write(fd, &ie, sizeof(ie));
+        observe_config_write(now_ns() - start);
+        if (stat == -1) {
             perror("set gain");
             return -1;
         }
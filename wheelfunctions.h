@@ -23,6 +23,9 @@
 
 #include <libusb-1.0/libusb.h>
 
+/* time to wait for udev to recreate device nodes after the kernel driver was re-attached */
+#define UDEV_WAIT_SEC 2
+
 
 /*
  * Native method to set autcenter behaviour of LT wheels.
@@ -39,6 +42,18 @@
  */
 int set_autocenter(wheelstruct* w, int centerforce, int rampspeed);
 
+/*
+ * Wait UDEV_WAIT_SEC for udev to recreate device nodes after the kernel driver
+ * was re-attached (counted in the runtime statistics)
+ */
+void wait_udev();
+
+/*
+ * Register histogram of event device write times of mode in the runtime statistics.
+ * Keep the id and record every write with stats_observe_ns().
+ */
+int evdev_write_stats(const char *mode);
+
 /*
  * Set maximum rotation range of wheel in degrees
  * G25/G27/DFP support up to 900 degrees.
@@ -50,6 +65,13 @@ int set_range(wheelstruct* w, unsigned short int range);
  */
 unsigned short int clamprange(wheelstruct* w, unsigned short int range);
 
+/*
+ * Look up supported wheel by shortname (case insensitive) or by product id in
+ * native mode. Returns 0 if the wheel is not supported.
+ */
+wheelstruct *find_wheel(const char *shortname);
+wheelstruct *find_wheel_by_pid(unsigned int pid);
+
 /*
  * Search and list all known/supported wheels
  */
@@ -57,9 +79,34 @@ void list_devices();
 
 /*
  * Send custom command to USB device using interrupt transfer
+ *
+ * Waits while another ltwheelconf process uses the same wheel (see devlock.h).
+ * Commands of processes waiting at the same time are sent in one claim session.
+ * Returns <0 if the wheel could not be claimed or a transfer failed.
  */
 int send_command(libusb_device_handle *handle, cmdstruct command );
 
+/*
+ * Building blocks of send_command() for sending several commands in one session:
+ * claim_wheel() locks the wheel, detaches the kernel driver and claims the interface
+ * (returns <0 and leaves the wheel unlocked if claiming failed),
+ * send_command_claimed() only does the transfers (returns <0 if one failed),
+ * release_wheel() releases the interface, re-attaches the kernel driver and unlocks.
+ */
+int claim_wheel(libusb_device_handle *handle);
+int send_command_claimed(libusb_device_handle *handle, cmdstruct command );
+void release_wheel(libusb_device_handle *handle);
+
+/*
+ * Send command through the hidraw node of the wheel. This reaches the same endpoint
+ * as send_command(), but the kernel driver stays bound, so the event device of the
+ * wheel is not recreated. Wheels have no report ids and 7 byte output reports, so
+ * the last byte of each command string is not sent.
+ * open_wheel_hidraw() returns -1 if the wheel has no hidraw node.
+ */
+int open_wheel_hidraw(wheelstruct *w);
+int send_command_hidraw(int fd, cmdstruct command);
+
 /*
  * Logitech wheels are in a kind of restricted mode when initially connected via usb.
  * In this restricted mode
@@ -170,3 +170,23 @@ int get_autocenter_cmd(cmdstruct *c, int centerforce, int rampspeed)
     return 0;
 }
 
+
+/* used by G27
+ *
+ * Lights up the rev LEDs given by the lower 5 bits of leds (bit 0: outer left green,
+ * bit 4: red in the middle)
+ */
+int get_leds_cmd_G27(cmdstruct *c, int leds)
+{
+    c->cmds[0][0] = 0xf8;
+    c->cmds[0][1] = 0x12;
+    c->cmds[0][2] = leds & 0x1f;
+    c->cmds[0][3] = 0x00;
+    c->cmds[0][4] = 0x00;
+    c->cmds[0][5] = 0x00;
+    c->cmds[0][6] = 0x00;
+    c->cmds[0][7] = 0x00;
+
+    c->numCmds = 1;
+    return 0;
+}
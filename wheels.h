@@ -42,6 +42,7 @@ typedef struct {
     int (*get_nativemode_cmd)(cmdstruct *c);
     int (*get_range_cmd)(cmdstruct *c, int range);
     int (*get_autocenter_cmd)(cmdstruct *c, int centerforce, int rampspeed);
+    int (*get_leds_cmd)(cmdstruct *c, int leds);
 }wheelstruct;
 
 
@@ -52,6 +53,7 @@ int get_nativemode_cmd_G27(cmdstruct *c);
 int get_range_cmd(cmdstruct *c, int range);
 int get_range_cmd2(cmdstruct *c, int range);
 int get_autocenter_cmd(cmdstruct *c, int centerforce, int rampspeed);
+int get_leds_cmd_G27(cmdstruct *c, int leds);
 
 
 static const wheelstruct wheels[] = {
@@ -65,6 +67,7 @@ static const wheelstruct wheels[] = {
         0,
         0,
         0,
+        0,
         0
     },
     {
@@ -77,7 +80,8 @@ static const wheelstruct wheels[] = {
         0x0019,
         0,
         0,
-        &get_autocenter_cmd
+        &get_autocenter_cmd,
+        0
     },
     {
         "MF",
@@ -89,6 +93,7 @@ static const wheelstruct wheels[] = {
         0,
         0,
         0,
+        0,
         0
     },
     {
@@ -101,7 +106,8 @@ static const wheelstruct wheels[] = {
         0x1106,
         &get_nativemode_cmd_DFP,
         &get_range_cmd2,
-        &get_autocenter_cmd
+        &get_autocenter_cmd,
+        0
     },
     {
         "G25",
@@ -113,7 +119,8 @@ static const wheelstruct wheels[] = {
         0x1222,
         &get_nativemode_cmd_G25,
         &get_range_cmd,
-        &get_autocenter_cmd
+        &get_autocenter_cmd,
+        0
     },
     {
         "DFGT",
@@ -125,7 +132,8 @@ static const wheelstruct wheels[] = {
         0,
         &get_nativemode_cmd_DFGT,
         &get_range_cmd,
-        &get_autocenter_cmd
+        &get_autocenter_cmd,
+        0
     },
     {
         "G27",
@@ -137,7 +145,8 @@ static const wheelstruct wheels[] = {
         0,
         &get_nativemode_cmd_G27,
         &get_range_cmd,
-        &get_autocenter_cmd
+        &get_autocenter_cmd,
+        &get_leds_cmd_G27
     }
 };
 